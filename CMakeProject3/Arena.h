@@ -0,0 +1,200 @@
+#pragma once
+
+#include "CoalesedAllocator.h"
+#include "FixedSizeAllocator.h"
+#include "SizeClasses.h"
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <tuple>
+
+namespace detail {
+
+template<size_t... I>
+std::tuple<FixedSizeAllocator<SizeClasses[I]>...> make_fixed_size_tiers(std::index_sequence<I...>);
+
+}
+
+// a FixedSizeAllocator for every entry of SizeClasses
+using FixedSizeTiers = decltype(detail::make_fixed_size_tiers(std::make_index_sequence<SizeClassesCount>()));
+
+// Operations of a size class on a type-erased FixedSizeAllocator,
+// MemoryAllocator reaches every class through one table instead of a switch over the templates.
+struct SizeClassDescriptor
+{
+	size_t size;
+	void* (*alloc)(void* tier);
+	int (*alloc_batch)(void* tier, void** blocks, int count);
+	void (*free)(void* tier, void* p);
+	bool (*free_remote)(void* tier, void* p);
+	void (*drain_remote_frees)(void* tier);
+	std::mutex& (*get_lock)(void* tier);
+};
+
+namespace detail {
+
+template<int SizeClass>
+struct SizeClassOperations
+{
+	using Tier = std::tuple_element_t<SizeClass, FixedSizeTiers>;
+
+	static void* alloc(void* tier)
+	{
+		return static_cast<Tier*>(tier)->alloc(SizeClasses[SizeClass]);
+	}
+
+	static int alloc_batch(void* tier, void** blocks, int count)
+	{
+		for (int i = 0; i < count; ++i) {
+			blocks[i] = static_cast<Tier*>(tier)->alloc(SizeClasses[SizeClass]);
+			if (!blocks[i]) {
+				return i;
+			}
+		}
+		return count;
+	}
+
+	static void free(void* tier, void* p)
+	{
+		static_cast<Tier*>(tier)->free(p);
+	}
+
+	static bool free_remote(void* tier, void* p)
+	{
+		return static_cast<Tier*>(tier)->free_remote(p);
+	}
+
+	static void drain_remote_frees(void* tier)
+	{
+		static_cast<Tier*>(tier)->drain_remote_frees();
+	}
+
+	static std::mutex& get_lock(void* tier)
+	{
+		return static_cast<Tier*>(tier)->get_lock();
+	}
+};
+
+template<size_t... I>
+constexpr std::array<SizeClassDescriptor, SizeClassesCount> make_size_class_descriptors(std::index_sequence<I...>)
+{
+	return { {
+		{
+			SizeClasses[I],
+			&SizeClassOperations<I>::alloc,
+			&SizeClassOperations<I>::alloc_batch,
+			&SizeClassOperations<I>::free,
+			&SizeClassOperations<I>::free_remote,
+			&SizeClassOperations<I>::drain_remote_frees,
+			&SizeClassOperations<I>::get_lock,
+		}...
+	} };
+}
+
+}
+
+constexpr std::array<SizeClassDescriptor, SizeClassesCount> SizeClassDescriptors = detail::make_size_class_descriptors(std::make_index_sequence<SizeClassesCount>());
+
+// One full set of tiers. MemoryAllocator spreads threads over its arenas,
+// every page knows the allocator it came from, so blocks are always freed into their own arena.
+class Arena
+{
+public:
+	explicit Arena(CoalesedAllocator::FitPolicy fit_policy = CoalesedAllocator::FitPolicy::SegregatedFit, int empty_pages_limit = DefaultEmptyPagesLimit,
+		bool huge_pages = false)
+		: coalesed(fit_policy)
+	{
+		coalesed.set_huge_pages(huge_pages);
+		int size_class = 0;
+		for_each_fixed_size([&](auto& allocator) {
+			fixed_size_tiers[size_class++] = &allocator;
+			allocator.set_empty_pages_limit(empty_pages_limit);
+		});
+	}
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void init()
+	{
+		for_each_fixed_size([](auto& allocator) {
+			allocator.init();
+		});
+		coalesed.init();
+	}
+
+	void destroy()
+	{
+		for_each_fixed_size([](auto& allocator) {
+			allocator.destroy();
+		});
+		coalesed.destroy();
+	}
+
+	template<class F>
+	void for_each_fixed_size(F&& f)
+	{
+		std::apply([&](auto&... allocators) {
+			(f(allocators), ...);
+		}, fixed_size);
+	}
+
+	template<class F>
+	void for_each_fixed_size(F&& f) const
+	{
+		std::apply([&](const auto&... allocators) {
+			(f(allocators), ...);
+		}, fixed_size);
+	}
+
+	// the size class comes from the slab slice of the page, only the owner is read from its header
+	bool owns(const FixedSizePage* page) const
+	{
+		return page->owner == fixed_size_tiers[SlabRegion::instance().size_class_of(page)];
+	}
+
+	int get_fixed_size_pages_count() const
+	{
+		int pages_count = 0;
+		for_each_fixed_size([&](const auto& allocator) {
+			pages_count += allocator.get_pages_count();
+		});
+		return pages_count;
+	}
+
+	size_t get_fixed_size_released_pages_count() const
+	{
+		size_t released_pages = 0;
+		for_each_fixed_size([&](const auto& allocator) {
+			released_pages += allocator.get_released_pages_count();
+		});
+		return released_pages;
+	}
+
+#ifdef _DEBUG
+	void dumpStat() const
+	{
+		for_each_fixed_size([](const auto& allocator) {
+			allocator.dumpStat();
+		});
+		coalesed.dumpStat();
+	}
+
+	void dumpBlocks() const
+	{
+		for_each_fixed_size([](const auto& allocator) {
+			allocator.dumpBlocks();
+		});
+		coalesed.dumpBlocks();
+	}
+#endif
+
+	FixedSizeTiers fixed_size;
+	void* fixed_size_tiers[SizeClassesCount]; // elements of fixed_size by class, for SizeClassDescriptors
+	alignas(64) CoalesedAllocator coalesed;
+
+	int index = 0;
+	Arena* next_arena = nullptr;
+	std::atomic<int> threads_count{ 0 }; // threads allocating here, an owned thread arena has exactly one
+};
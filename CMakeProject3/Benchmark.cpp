@@ -0,0 +1,732 @@
+// Benchmark.cpp: measurements of the allocators, run with a benchmark name to run only that one.
+//
+
+#include "CoalesedAllocator.h"
+#include "FixedSizeAllocator.h"
+#include "MemoryAllocator.h"
+#include "PageMap.h"
+#include "SizeClasses.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+template<int AllocSize>
+void fixed_size_density(size_t blocks_count)
+{
+	FixedSizeAllocator<AllocSize> allocator;
+	allocator.init();
+
+	vector<void*> ptrs;
+	ptrs.reserve(blocks_count);
+	for (size_t i = 0; i < blocks_count; ++i) {
+		ptrs.push_back(allocator.alloc(AllocSize));
+	}
+
+	size_t payload = blocks_count * AllocSize;
+	size_t mapped = static_cast<size_t>(allocator.get_pages_count()) * PageSize;
+	cout << setw(6) << AllocSize
+		<< setw(14) << FixedSizeAllocator<AllocSize>::BucketsInPage
+		<< setw(12) << allocator.get_pages_count()
+		<< setw(11) << fixed << setprecision(2) << 100.0 * payload / mapped << "%" << endl;
+
+	for (auto& ptr : ptrs) {
+		allocator.free(ptr);
+	}
+	allocator.destroy();
+}
+
+// payload bytes against the bytes taken from the OS when every block is in use
+void density()
+{
+	constexpr size_t PayloadSize = 64 * 1024 * 1024;
+
+	cout << "Fixed-size payload density, " << PayloadSize / (1024 * 1024) << "MB of live blocks per class" << endl;
+	cout << setw(6) << "size" << setw(14) << "blocks/page" << setw(12) << "pages" << setw(12) << "density" << endl;
+	for (int size_class = 0; size_class < SizeClassesCount; ++size_class) {
+		with_size_class(size_class, [](auto size_class_constant) {
+			constexpr size_t AllocSize = SizeClasses[size_class_constant];
+			fixed_size_density<AllocSize>(PayloadSize / AllocSize);
+		});
+	}
+	cout << endl;
+}
+
+// sizes requested through a std::allocator
+vector<size_t> recorded_sizes;
+
+template<class T>
+struct RecordingAllocator
+{
+	using value_type = T;
+
+	RecordingAllocator() = default;
+	template<class U>
+	RecordingAllocator(const RecordingAllocator<U>&) {}
+
+	T* allocate(size_t n)
+	{
+		recorded_sizes.push_back(n * sizeof(T));
+		return std::allocator<T>().allocate(n);
+	}
+
+	void deallocate(T* p, size_t n)
+	{
+		std::allocator<T>().deallocate(p, n);
+	}
+
+	template<class U>
+	bool operator==(const RecordingAllocator<U>&) const { return true; }
+	template<class U>
+	bool operator!=(const RecordingAllocator<U>&) const { return false; }
+};
+
+using RecordedString = basic_string<char, char_traits<char>, RecordingAllocator<char>>;
+
+struct RecordedStringHash
+{
+	size_t operator()(const RecordedString& value) const
+	{
+		return hash<string_view>()(string_view(value.data(), value.size()));
+	}
+};
+
+vector<size_t> record_map_of_strings()
+{
+	recorded_sizes.clear();
+	mt19937 rng(1);
+	map<int, RecordedString, less<int>, RecordingAllocator<pair<const int, RecordedString>>> values;
+	for (int i = 0; i < 100000; ++i) {
+		values.emplace(static_cast<int>(rng()), RecordedString(rng() % 100, 'x'));
+	}
+	return recorded_sizes;
+}
+
+vector<size_t> record_hash_map()
+{
+	recorded_sizes.clear();
+	mt19937 rng(2);
+	unordered_map<RecordedString, long long, RecordedStringHash, equal_to<RecordedString>, RecordingAllocator<pair<const RecordedString, long long>>> values;
+	for (int i = 0; i < 100000; ++i) {
+		values[RecordedString(8 + rng() % 32, static_cast<char>('a' + rng() % 26))] = i;
+	}
+	return recorded_sizes;
+}
+
+vector<size_t> record_vectors()
+{
+	recorded_sizes.clear();
+	mt19937 rng(3);
+	for (int i = 0; i < 10000; ++i) {
+		vector<int, RecordingAllocator<int>> values;
+		size_t length = rng() % 1000;
+		for (size_t j = 0; j < length; ++j) {
+			values.push_back(static_cast<int>(j));
+		}
+	}
+	return recorded_sizes;
+}
+
+// the size distribution of the scaling benchmark
+vector<size_t> record_mixed()
+{
+	vector<size_t> sizes;
+	mt19937 rng(0);
+	uniform_int_distribution<size_t> small_size(8, 512);
+	uniform_int_distribution<size_t> medium_size(513, 4096);
+	for (int i = 0; i < 1000000; ++i) {
+		sizes.push_back(rng() % 10 ? small_size(rng) : medium_size(rng));
+	}
+	return sizes;
+}
+
+// bytes a request used to take: 16..512 powers of two, the coalescing tier above
+size_t old_slot_size(size_t size)
+{
+	if (size <= 512) {
+		size_t slot = 16;
+		while (slot < size) {
+			slot *= 2;
+		}
+		return slot;
+	}
+	return ((size + CoalesedAllocator::BlockAlignment - 1) & ~(CoalesedAllocator::BlockAlignment - 1)) + CoalesedAllocator::BlockHeaderSize;
+}
+
+size_t new_slot_size(size_t size)
+{
+	return SizeClasses[size_class_of(size)];
+}
+
+// slot bytes which aren't payload, old six classes against the generated table
+void fragmentation()
+{
+	struct {
+		const char* name;
+		vector<size_t> (*record)();
+	} workloads[] = {
+		{ "map<int, string>", record_map_of_strings },
+		{ "unordered_map<string, long long>", record_hash_map },
+		{ "vector<int> growth", record_vectors },
+		{ "mixed 8..4096", record_mixed },
+	};
+
+	cout << "Internal fragmentation of requests up to " << MaxFixedSize << " bytes" << endl;
+	cout << setw(34) << "workload" << setw(12) << "requests" << setw(14) << "old classes" << setw(14) << "new classes" << endl;
+	for (auto& workload : workloads) {
+		size_t requests = 0;
+		size_t payload = 0;
+		size_t old_slots = 0;
+		size_t new_slots = 0;
+		for (size_t size : workload.record()) {
+			if (size == 0 || size > MaxFixedSize) {
+				continue;
+			}
+			++requests;
+			payload += size;
+			old_slots += old_slot_size(size);
+			new_slots += new_slot_size(size);
+		}
+		cout << setw(34) << workload.name << setw(12) << requests
+			<< setw(13) << fixed << setprecision(2) << 100.0 * (old_slots - payload) / old_slots << "%"
+			<< setw(13) << 100.0 * (new_slots - payload) / new_slots << "%" << endl;
+	}
+	cout << "(" << SizeClassesCount << " classes instead of 6)" << endl << endl;
+}
+
+// alloc+free pairs per second, every thread replaces random blocks of its own live set
+double mixed_workload(MemoryAllocator& allocator, int threads_count, size_t pairs_per_thread)
+{
+	auto start = chrono::steady_clock::now();
+
+	vector<thread> threads;
+	for (int t = 0; t < threads_count; ++t) {
+		threads.emplace_back([&allocator, t, pairs_per_thread]() {
+			constexpr size_t LiveBlocks = 1024;
+			vector<void*> live(LiveBlocks, nullptr);
+
+			// mostly small objects with a tail of medium ones
+			mt19937 rng(t);
+			uniform_int_distribution<size_t> small_size(8, 512);
+			uniform_int_distribution<size_t> medium_size(513, 4096);
+
+			for (size_t i = 0; i < pairs_per_thread; ++i) {
+				size_t slot = rng() % LiveBlocks;
+				if (live[slot]) {
+					allocator.free(live[slot]);
+				}
+				live[slot] = allocator.alloc(rng() % 10 ? small_size(rng) : medium_size(rng));
+			}
+
+			for (auto& ptr : live) {
+				if (ptr) {
+					allocator.free(ptr);
+				}
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+	return threads_count * pairs_per_thread / elapsed.count();
+}
+
+// throughput of a mixed-size workload on 1..N threads
+void scaling()
+{
+	constexpr size_t PairsPerThread = 1000000;
+	int max_threads = max(4, static_cast<int>(thread::hardware_concurrency()));
+
+	MemoryAllocator::Options concurrent;
+	concurrent.concurrent = true;
+	MemoryAllocator::Options cached;
+	cached.thread_cache = true;
+	MemoryAllocator::Options arenas;
+	arenas.thread_arenas = true;
+
+	cout << "Mixed-size workload scaling, " << PairsPerThread << " alloc/free pairs per thread" << endl;
+	cout << setw(8) << "threads" << setw(20) << "locked, Mpairs/s" << setw(10) << "speedup"
+		<< setw(20) << "cached, Mpairs/s" << setw(10) << "speedup"
+		<< setw(20) << "arenas, Mpairs/s" << setw(10) << "speedup" << endl;
+
+	double locked_base = 0;
+	double cached_base = 0;
+	double arenas_base = 0;
+	for (int threads_count = 1; threads_count <= max_threads; ++threads_count) {
+		MemoryAllocator locked_allocator(concurrent);
+		locked_allocator.init();
+		double locked = mixed_workload(locked_allocator, threads_count, PairsPerThread);
+		locked_allocator.destroy();
+
+		MemoryAllocator cached_allocator(cached);
+		cached_allocator.init();
+		double with_cache = mixed_workload(cached_allocator, threads_count, PairsPerThread);
+		cached_allocator.destroy();
+
+		MemoryAllocator arenas_allocator(arenas);
+		arenas_allocator.init();
+		double with_arenas = mixed_workload(arenas_allocator, threads_count, PairsPerThread);
+		arenas_allocator.destroy();
+
+		if (threads_count == 1) {
+			locked_base = locked;
+			cached_base = with_cache;
+			arenas_base = with_arenas;
+		}
+		cout << setw(8) << threads_count
+			<< setw(20) << fixed << setprecision(2) << locked / 1e6 << setw(10) << locked / locked_base
+			<< setw(20) << with_cache / 1e6 << setw(10) << with_cache / cached_base
+			<< setw(20) << with_arenas / 1e6 << setw(10) << with_arenas / arenas_base << endl;
+	}
+	cout << "(hardware threads: " << thread::hardware_concurrency() << ")" << endl << endl;
+}
+
+// random replacement in a live set of coalesced blocks, sizes spread log-uniformly over 4KB..1MB
+void fit_policy_workload(const char* name, CoalesedAllocator::FitPolicy policy)
+{
+	constexpr size_t LiveBlocks = 2000;
+	constexpr size_t Operations = 200000;
+
+	CoalesedAllocator allocator(policy);
+	allocator.init();
+
+	mt19937 rng(4);
+	uniform_real_distribution<double> log_size(12, 20);
+	vector<void*> live(LiveBlocks, nullptr);
+	vector<size_t> live_sizes(LiveBlocks, 0);
+	vector<double> latencies;
+	latencies.reserve(Operations);
+
+	size_t live_payload = 0;
+	size_t peak_payload = 0;
+	for (size_t i = 0; i < Operations; ++i) {
+		size_t slot = rng() % LiveBlocks;
+		size_t size = static_cast<size_t>(pow(2.0, log_size(rng)));
+
+		auto start = chrono::steady_clock::now();
+		if (live[slot]) {
+			allocator.free(live[slot]);
+		}
+		live[slot] = allocator.alloc(size);
+		latencies.push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - start).count());
+
+		live_payload += size - live_sizes[slot];
+		live_sizes[slot] = size;
+		peak_payload = max(peak_payload, live_payload);
+	}
+
+	size_t mapped = static_cast<size_t>(allocator.get_pages_count()) * CoalesedPageSize;
+	sort(latencies.begin(), latencies.end());
+	double mean = 0;
+	for (double latency : latencies) {
+		mean += latency / latencies.size();
+	}
+	cout << setw(26) << name << setw(8) << allocator.get_pages_count()
+		<< setw(15) << fixed << setprecision(2) << 100.0 * (mapped - peak_payload) / mapped << "%"
+		<< setw(14) << setprecision(0) << mean << setw(14) << latencies[latencies.size() * 99 / 100] << endl;
+
+	for (auto& ptr : live) {
+		if (ptr) {
+			allocator.free(ptr);
+		}
+	}
+	allocator.destroy();
+}
+
+// fragmentation and latency of the coalescing tier under every fit policy
+void fit_policies()
+{
+	cout << "Coalesced fit policies, free+alloc pairs over 2000 live blocks of 4KB..1MB" << endl;
+	cout << setw(26) << "policy" << setw(8) << "pages" << setw(16) << "fragmentation"
+		<< setw(14) << "mean, ns" << setw(14) << "p99, ns" << endl;
+	fit_policy_workload("segregated fit", CoalesedAllocator::FitPolicy::SegregatedFit);
+	fit_policy_workload("best fit", CoalesedAllocator::FitPolicy::BestFit);
+	fit_policy_workload("address-ordered best fit", CoalesedAllocator::FitPolicy::AddressOrderedBestFit);
+	cout << "(fragmentation: mapped bytes not covered by the peak live payload)" << endl << endl;
+}
+
+// mean time from init of a fresh allocator to its first block of the given size
+double first_alloc_latency(size_t size, int& pages_count)
+{
+	constexpr int Repeats = 1000;
+
+	double total = 0;
+	for (int i = 0; i < Repeats; ++i) {
+		MemoryAllocator allocator;
+		auto start = chrono::steady_clock::now();
+		allocator.init();
+		void* ptr = size ? allocator.alloc(size) : nullptr;
+		total += chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+		MemoryAllocator::ArenaStats stats = allocator.get_arena_stats(0);
+		pages_count = stats.fixed_size_pages + stats.coalesed_pages;
+		if (ptr) {
+			allocator.free(ptr);
+		}
+		allocator.destroy();
+	}
+	return total / Repeats;
+}
+
+// cost of a short-lived allocator: every tier maps its first page on first use
+void startup()
+{
+	cout << "Init to first alloc, fresh allocators" << endl;
+	cout << setw(26) << "first block" << setw(14) << "mean, ns" << setw(8) << "pages" << endl;
+
+	struct {
+		const char* name;
+		size_t size;
+	} cases[] = {
+		{ "none, init only", 0 },
+		{ "600 bytes", 600 },
+		{ "64KB", 64 * 1024 },
+	};
+	for (auto& test_case : cases) {
+		int pages_count = 0;
+		double latency = first_alloc_latency(test_case.size, pages_count);
+		cout << setw(26) << test_case.name << setw(14) << fixed << setprecision(0) << latency << setw(8) << pages_count << endl;
+	}
+	cout << endl;
+}
+
+// grows a buffer by doubling from initial_size up to final_size, the way vector does, and gives mean time
+// of one whole growth; moves counts the steps where the block has changed its place
+double doubling_growth(size_t initial_size, size_t final_size, int repeats, bool use_realloc, int& moves)
+{
+	MemoryAllocator allocator;
+	allocator.init();
+
+	double total = 0;
+	moves = 0;
+	for (int repeat = 0; repeat < repeats; ++repeat) {
+		auto start = chrono::steady_clock::now();
+		size_t size = initial_size;
+		char* ptr = static_cast<char*>(allocator.alloc(size));
+		memset(ptr, 1, size);
+		while (size < final_size) {
+			size_t new_size = size * 2;
+			char* new_ptr;
+			if (use_realloc) {
+				new_ptr = static_cast<char*>(allocator.realloc(ptr, new_size));
+			}
+			else {
+				new_ptr = static_cast<char*>(allocator.alloc(new_size));
+				memcpy(new_ptr, ptr, size);
+				allocator.free(ptr);
+			}
+			if (new_ptr != ptr) {
+				++moves;
+			}
+			memset(new_ptr + size, 1, new_size - size);
+			ptr = new_ptr;
+			size = new_size;
+		}
+		allocator.free(ptr);
+		total += chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+	}
+	allocator.destroy();
+	moves /= repeats;
+	return total / repeats;
+}
+
+// in-place growth over free neighbours against always moving the block
+void realloc_growth()
+{
+	cout << "Doubling growth from 16 bytes, mean time of one growth" << endl;
+	cout << setw(10) << "up to" << setw(22) << "alloc+copy+free, us" << setw(8) << "moves"
+		<< setw(14) << "realloc, us" << setw(8) << "moves" << endl;
+
+	for (size_t final_size : { 64 * 1024, 1024 * 1024, 8 * 1024 * 1024 }) {
+		int copy_moves = 0;
+		int realloc_moves = 0;
+		double copy_time = doubling_growth(16, final_size, 20, false, copy_moves);
+		double realloc_time = doubling_growth(16, final_size, 20, true, realloc_moves);
+		cout << setw(8) << final_size / 1024 << "KB" << setw(22) << fixed << setprecision(1) << copy_time << setw(8) << copy_moves
+			<< setw(14) << realloc_time << setw(8) << realloc_moves << endl;
+	}
+	cout << endl;
+}
+
+// huge blocks are remapped instead of copied, the cost follows the pages and not the bytes
+void huge_realloc_growth()
+{
+	constexpr size_t InitialSize = 16 * 1024 * 1024;
+
+	cout << "Doubling growth from " << InitialSize / (1024 * 1024) << "MB, mean time of one growth" << endl;
+	cout << setw(10) << "up to" << setw(22) << "alloc+copy+free, ms" << setw(14) << "realloc, ms" << endl;
+
+	for (size_t final_size : { 64 * 1024 * 1024, 256 * 1024 * 1024, 1024 * 1024 * 1024 }) {
+		int moves = 0;
+		double copy_time = doubling_growth(InitialSize, final_size, 3, false, moves);
+		double realloc_time = doubling_growth(InitialSize, final_size, 3, true, moves);
+		cout << setw(8) << final_size / (1024 * 1024) << "MB" << setw(22) << fixed << setprecision(1) << copy_time / 1000
+			<< setw(14) << realloc_time / 1000 << endl;
+	}
+	cout << endl;
+}
+
+// mean time of allocating a scratch buffer, writing every page of it and freeing it again
+double scratch_buffer_cycle(size_t size, size_t huge_cache_bytes)
+{
+	constexpr int Cycles = 200;
+
+	MemoryAllocator::Options options;
+	options.huge_cache_bytes = huge_cache_bytes;
+	MemoryAllocator allocator(options);
+	allocator.init();
+
+	auto start = chrono::steady_clock::now();
+	for (int cycle = 0; cycle < Cycles; ++cycle) {
+		char* ptr = static_cast<char*>(allocator.alloc(size));
+		for (size_t offset = 0; offset < size; offset += 4096) {
+			ptr[offset] = static_cast<char>(cycle);
+		}
+		allocator.free(ptr);
+	}
+	double total = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+	allocator.destroy();
+	return total / Cycles;
+}
+
+// repeated huge blocks with and without the cache of retired mappings
+void huge_reuse()
+{
+	cout << "Huge scratch buffers, alloc + write every page + free, mean time" << endl;
+	cout << setw(10) << "size" << setw(16) << "no cache, us" << setw(16) << "cache, us" << endl;
+
+	for (size_t size : { 16 * 1024 * 1024, 32 * 1024 * 1024, 64 * 1024 * 1024 }) {
+		double uncached_time = scratch_buffer_cycle(size, 0);
+		double cached_time = scratch_buffer_cycle(size, DefaultHugeCacheBytes);
+		cout << setw(8) << size / (1024 * 1024) << "MB" << setw(16) << fixed << setprecision(1) << uncached_time
+			<< setw(16) << cached_time << endl;
+	}
+	cout << endl;
+}
+
+// mean time of a random 8 byte read over blocks_count blocks of block_size bytes, written once beforehand
+double random_access_latency(size_t block_size, int blocks_count, bool huge_pages)
+{
+	constexpr int Reads = 16 * 1024 * 1024;
+
+	MemoryAllocator::Options options;
+	options.huge_pages = huge_pages;
+	MemoryAllocator allocator(options);
+	allocator.init();
+
+	size_t words_count = block_size / sizeof(uint64_t);
+	vector<uint64_t*> blocks;
+	for (int i = 0; i < blocks_count; ++i) {
+		auto* block = static_cast<uint64_t*>(allocator.alloc(block_size));
+		for (size_t word = 0; word < words_count; ++word) {
+			block[word] = word;
+		}
+		blocks.push_back(block);
+	}
+
+	uint64_t state = 88172645463325252ull;
+	uint64_t sum = 0;
+	auto start = chrono::steady_clock::now();
+	for (int read = 0; read < Reads; ++read) {
+		// xorshift, cheaper than the reads it drives
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		sum += blocks[state % blocks_count][(state >> 8) % words_count];
+	}
+	double total = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+	for (auto* block : blocks) {
+		allocator.free(block);
+	}
+	allocator.destroy();
+	if (sum == 1) {
+		cout << "";
+	}
+	return total / Reads;
+}
+
+// TLB misses of random reads over big buffers with 4K pages and with huge pages
+void huge_pages()
+{
+	cout << "Random 8 byte reads over 512MB, mean time" << endl;
+	cout << setw(22) << "blocks" << setw(16) << "4K pages, ns" << setw(18) << "huge pages, ns" << endl;
+
+	struct {
+		const char* name;
+		size_t block_size;
+		int blocks_count;
+	} cases[] = {
+		{ "64 x 8MB coalesced", 8 * 1024 * 1024, 64 },
+		{ "1 x 512MB huge", 512 * 1024 * 1024, 1 },
+	};
+	for (auto& test_case : cases) {
+		double small_pages_latency = random_access_latency(test_case.block_size, test_case.blocks_count, false);
+		double huge_pages_latency = random_access_latency(test_case.block_size, test_case.blocks_count, true);
+		cout << setw(22) << test_case.name << setw(16) << fixed << setprecision(1) << small_pages_latency
+			<< setw(18) << huge_pages_latency << endl;
+	}
+	cout << endl;
+}
+
+// fresh fixed-size pages over a big working set of small blocks, committed a chunk per syscall
+void slab_chunks()
+{
+	constexpr size_t PayloadSize = size_t(1) << 30;
+	constexpr size_t BlocksCount = PayloadSize / 32;
+
+	FixedSizeAllocator<32> allocator;
+	allocator.init();
+	vector<void*> ptrs;
+	ptrs.reserve(BlocksCount);
+
+	size_t chunks_count = SlabRegion::instance().get_chunks_count();
+	auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < BlocksCount; ++i) {
+		ptrs.push_back(allocator.alloc(32));
+	}
+	double total = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	chunks_count = SlabRegion::instance().get_chunks_count() - chunks_count;
+
+	cout << "Filling " << PayloadSize / (1024 * 1024) << "MB with 32 byte blocks" << endl;
+	cout << setw(12) << "time, ms" << setw(10) << "pages" << setw(16) << "chunk commits" << endl;
+	cout << setw(12) << fixed << setprecision(1) << total << setw(10) << allocator.get_pages_count()
+		<< setw(16) << chunks_count << endl;
+	cout << endl;
+
+	for (auto& ptr : ptrs) {
+		allocator.free(ptr);
+	}
+	allocator.destroy();
+}
+
+// mean time of finding the page of every pointer with the page map
+double page_map_lookup_latency(const vector<char*>& ptrs)
+{
+	PageMap& page_map = PageMap::instance();
+	uintptr_t sum = 0;
+	auto start = chrono::steady_clock::now();
+	for (char* ptr : ptrs) {
+		sum += reinterpret_cast<uintptr_t>(page_map.lookup(ptr).metadata);
+	}
+	double total = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+	if (sum == 1) {
+		cout << "";
+	}
+	return total / ptrs.size();
+}
+
+// interior pointers of the tiers to their page metadata, against walking the page list of a size class
+void page_map()
+{
+	constexpr size_t LookupsCount = 1024 * 1024;
+	constexpr size_t WalksCount = 4 * 1024;
+	constexpr size_t FixedSizePayload = 64 * 1024 * 1024;
+
+	mt19937 rng(0);
+	cout << "Pointer to page lookups, random interior pointers, mean time" << endl;
+	cout << setw(26) << "blocks" << setw(16) << "page map, ns" << setw(18) << "list walk, ns" << endl;
+
+	// the list of one size class is all a lookup had without the map
+	FixedSizeAllocator<64> fixed_size;
+	fixed_size.init();
+	vector<void*> blocks;
+	for (size_t i = 0; i < FixedSizePayload / 64; ++i) {
+		blocks.push_back(fixed_size.alloc(64));
+	}
+	vector<char*> ptrs;
+	for (size_t i = 0; i < LookupsCount; ++i) {
+		ptrs.push_back(static_cast<char*>(blocks[rng() % blocks.size()]) + rng() % 64);
+	}
+	double map_latency = page_map_lookup_latency(ptrs);
+
+	size_t found = 0;
+	auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < WalksCount; ++i) {
+		for (FixedSizePage* page = fixed_size.get_first_page(); page; page = page->next_page) {
+			if (ptrs[i] >= reinterpret_cast<char*>(page) && ptrs[i] < reinterpret_cast<char*>(page) + PageSize) {
+				++found;
+				break;
+			}
+		}
+	}
+	double walk_latency = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / WalksCount;
+	cout << setw(26) << to_string(fixed_size.get_pages_count()) + " fixed-size pages" << setw(16) << fixed << setprecision(1) << map_latency
+		<< setw(18) << walk_latency << endl;
+	for (auto& block : blocks) {
+		fixed_size.free(block);
+	}
+	fixed_size.destroy();
+
+	// the other tiers had no way at all
+	struct {
+		const char* name;
+		size_t size;
+		int blocks_count;
+	} cases[] = {
+		{ "256 x 1MB coalesced", 1024 * 1024, 256 },
+		{ "16 x 64MB huge", 64 * 1024 * 1024, 16 },
+	};
+	for (auto& test_case : cases) {
+		MemoryAllocator allocator;
+		allocator.init();
+		vector<char*> big_blocks;
+		for (int i = 0; i < test_case.blocks_count; ++i) {
+			big_blocks.push_back(static_cast<char*>(allocator.alloc(test_case.size)));
+		}
+		ptrs.clear();
+		for (size_t i = 0; i < LookupsCount; ++i) {
+			ptrs.push_back(big_blocks[rng() % big_blocks.size()] + rng() % test_case.size);
+		}
+		map_latency = page_map_lookup_latency(ptrs);
+		cout << setw(26) << test_case.name << setw(16) << map_latency << setw(18) << "-" << endl;
+		for (auto& block : big_blocks) {
+			allocator.free(block);
+		}
+		allocator.destroy();
+	}
+	cout << "page map leaves: " << PageMap::instance().get_leaves_count() << ", walks found " << found << " of " << WalksCount << endl;
+	cout << endl;
+}
+
+int main(int argc, char** argv)
+{
+	struct {
+		const char* name;
+		void (*run)();
+	} benchmarks[] = {
+		{ "density", density },
+		{ "scaling", scaling },
+		{ "fragmentation", fragmentation },
+		{ "fit", fit_policies },
+		{ "startup", startup },
+		{ "realloc", realloc_growth },
+		{ "huge realloc", huge_realloc_growth },
+		{ "huge reuse", huge_reuse },
+		{ "huge pages", huge_pages },
+		{ "slab chunks", slab_chunks },
+		{ "page map", page_map },
+	};
+
+	for (auto& benchmark : benchmarks) {
+		if (argc < 2 || strcmp(argv[1], benchmark.name) == 0) {
+			benchmark.run();
+		}
+	}
+	return 0;
+}
@@ -1,149 +1,1156 @@
-﻿// CMakeProject3.cpp: определяет точку входа для приложения.
-//
-
-#include "CMakeProject3.h"
-#include "FixedSizeAllocator.h"
-#include "CoalesedAllocator.h"
-#include "MemoryAllocator.h"
-
-#include <rapidcheck.h>
-
-#include <algorithm>
-#include <random>
-
-using namespace std;
-
-int main()
-{
-	rc::check("fixed size alllocator",
-		[]() {
-			const auto smallInts = *rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 30));
-			FixedSizeAllocator<64> allocator;
-			allocator.init();
-
-			std::vector<void*> ptrs;
-			for (auto& value : smallInts) {
-				ptrs.push_back(allocator.alloc(value));
-			}
-
-			auto rng = std::default_random_engine{};
-			std::shuffle(ptrs.begin(), ptrs.end(), rng);
-
-			for (auto& value : ptrs) {
-				// shouldn't assert that there are corrupted block
-				allocator.free(value);
-			}
-
-			// shouldn't assert that there are non freed blocks
-			allocator.destroy();
-		}
-	);
-
-	rc::check("coalesed alllocator",
-		[]() {
-			const auto smallInts = *rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 30));
-			CoalesedAllocator allocator;
-			allocator.init();
-
-
-			std::vector<void*> ptrs;
-			for (auto& value : smallInts) {
-				ptrs.push_back(allocator.alloc(value));
-			}
-			
-			auto rng = std::default_random_engine{};
-			std::shuffle(ptrs.begin(), ptrs.end(), rng);
-
-			for (auto& value : ptrs) {
-				// shouldn't assert that there are corrupted block
-				allocator.free(value);
-			}
-
-			// shouldn't assert that there are non freed blocks
-			allocator.destroy();
-		}
-	);
-
-	rc::check("alllocator",
-		[]() {
-			const auto smallInts = *rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 1024*1024*10));
-			MemoryAllocator allocator;
-			allocator.init();
-
-			std::vector<void*> ptrs;
-			for (auto& value : smallInts) {
-				ptrs.push_back(allocator.alloc(value));
-			}
-
-			auto rng = std::default_random_engine{};
-			std::shuffle(ptrs.begin(), ptrs.end(), rng);
-
-			for (auto& value : ptrs) {
-				// shouldn't assert that there are corrupted block
-				allocator.free(value);
-			}
-
-			// shouldn't assert that there are non freed blocks
-			allocator.destroy();
-		}
-	);
-
-	cout << "Hello CMake." << endl;
-	MemoryAllocator allocator;
-	allocator.init();
-
-	int* pi = reinterpret_cast<int*>(allocator.alloc(sizeof(int)));
-	double* pd = reinterpret_cast<double*>(allocator.alloc(sizeof(double)));
-	int* pa = reinterpret_cast<int*>(allocator.alloc(10 * sizeof(int)));
-	int* a = reinterpret_cast<int*>(allocator.alloc(256 * sizeof(int)));
-
-	allocator.dumpStat();
-	allocator.dumpBlocks();
-
-
-	allocator.free(a);
-	allocator.free(pa);
-	allocator.free(pd);
-	allocator.free(pi);
-
-	allocator.destroy();
-
-
-	/*
-	cout << "Hello CMake."  << endl;
-	FixedSizeAllocator<512> allocator;
-	allocator.init();
-
-	int* pi = reinterpret_cast<int*>(allocator.alloc(sizeof(int)));
-	double* pd = reinterpret_cast<double*>(allocator.alloc(sizeof(double)));
-	int* pa = reinterpret_cast<int*>(allocator.alloc(10 * sizeof(int)));
-
-	allocator.dumpStat();
-	allocator.dumpBlocks();
-
-	allocator.free(pa);
-	allocator.free(pd);
-	allocator.free(pi);
-
-	allocator.destroy();
-	*/
-
-	/*
-	CoalesedAllocator allocator;
-	allocator.init();
-
-	int* pi = reinterpret_cast<int*>(allocator.alloc(sizeof(int)));
-	double* pd = reinterpret_cast<double*>(allocator.alloc(sizeof(double)));
-	int* pa = reinterpret_cast<int*>(allocator.alloc(10 * sizeof(int)));
-
-	// allocator.dumpStat();
-	// allocator.dumpBlocks();
-
-	allocator.free(pa);
-	allocator.free(pd);
-	allocator.free(pi);
-
-	allocator.destroy();
-	*/
-	return 0;
-}
+﻿// CMakeProject3.cpp: определяет точку входа для приложения.
+//
+
+#include "CMakeProject3.h"
+#include "FixedSizeAllocator.h"
+#include "CoalesedAllocator.h"
+#include "MemoryAllocator.h"
+
+#include <rapidcheck.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <thread>
+
+using namespace std;
+
+int main()
+{
+	// every property is checked, the exit code tells ctest whether any of them was falsified
+	bool ok = true;
+
+	ok &= rc::check("fixed size alllocator",
+		[]() {
+			const auto smallInts = *rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 30));
+			FixedSizeAllocator<64> allocator;
+			allocator.init();
+
+			std::vector<void*> ptrs;
+			for (auto& value : smallInts) {
+				ptrs.push_back(allocator.alloc(value));
+			}
+
+			auto rng = std::default_random_engine{};
+			std::shuffle(ptrs.begin(), ptrs.end(), rng);
+
+			for (auto& value : ptrs) {
+				// shouldn't assert that there are corrupted block
+				allocator.free(value);
+			}
+
+			// shouldn't assert that there are non freed blocks
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("fixed size alllocator reuses freed blocks",
+		[]() {
+			const auto smallInts = *rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 64));
+			FixedSizeAllocator<64> allocator;
+			allocator.init();
+
+			std::vector<unsigned char*> ptrs;
+			for (auto& value : smallInts) {
+				ptrs.push_back(reinterpret_cast<unsigned char*>(allocator.alloc(value)));
+			}
+
+			// free every second block and take the space back
+			for (size_t i = 0; i < ptrs.size(); i += 2) {
+				allocator.free(ptrs[i]);
+				ptrs[i] = reinterpret_cast<unsigned char*>(allocator.alloc(smallInts[i]));
+			}
+
+			for (size_t i = 0; i < ptrs.size(); ++i) {
+				std::fill(ptrs[i], ptrs[i] + smallInts[i], static_cast<unsigned char>(i));
+			}
+			for (size_t i = 0; i < ptrs.size(); ++i) {
+				// blocks shouldn't overlap
+				RC_ASSERT(std::count(ptrs[i], ptrs[i] + smallInts[i], static_cast<unsigned char>(i)) == smallInts[i]);
+				allocator.free(ptrs[i]);
+			}
+
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("fixed size alllocator releases empty pages",
+		[]() {
+			const auto count = *rc::gen::inRange(1, 4096);
+			const auto limit = *rc::gen::inRange(0, 4);
+			FixedSizeAllocator<512> allocator;
+			allocator.set_empty_pages_limit(limit);
+			allocator.init();
+
+			std::vector<void*> ptrs;
+			for (int i = 0; i < count; ++i) {
+				ptrs.push_back(allocator.alloc(512));
+			}
+			int pages_count = allocator.get_pages_count();
+
+			auto rng = std::default_random_engine{};
+			std::shuffle(ptrs.begin(), ptrs.end(), rng);
+			for (auto& ptr : ptrs) {
+				allocator.free(ptr);
+			}
+
+			// only the first pages which got empty are kept
+			int kept = std::min(pages_count, limit);
+			RC_ASSERT(allocator.get_pages_count() == kept);
+			RC_ASSERT(allocator.get_released_pages_count() == static_cast<size_t>(pages_count - kept));
+
+			// released pages are mapped again on demand
+			void* ptr = allocator.alloc(512);
+			RC_ASSERT(reinterpret_cast<uintptr_t>(ptr) != 0);
+			allocator.free(ptr);
+
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("fixed size alllocator takes pages in chunks",
+		[]() {
+			const auto count = *rc::gen::inRange(1, 1024*16);
+			FixedSizeAllocator<512> allocator;
+			allocator.init();
+
+			size_t chunks_count = SlabRegion::instance().get_chunks_count();
+			std::vector<void*> ptrs;
+			for (int i = 0; i < count; ++i) {
+				void* ptr = allocator.alloc(512);
+				memset(ptr, i, 512);
+				ptrs.push_back(ptr);
+			}
+
+			// pages come a chunk at a time, pages of committed chunks don't need a commit at all
+			size_t pages_bytes = static_cast<size_t>(allocator.get_pages_count()) * PageSize;
+			RC_ASSERT(SlabRegion::instance().get_chunks_count() - chunks_count <= pages_bytes / SlabChunkSize + 1);
+
+			// chunks are given back whole once all their pages are released
+			size_t released_chunks_count = SlabRegion::instance().get_released_chunks_count();
+			for (auto& ptr : ptrs) {
+				allocator.free(ptr);
+			}
+			allocator.destroy();
+			RC_ASSERT(SlabRegion::instance().get_released_chunks_count() - released_chunks_count >= pages_bytes / SlabChunkSize);
+		}
+	);
+
+	ok &= rc::check("fixed size alllocator drains remote frees",
+		[]() {
+			const auto smallInts = *rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 64));
+			FixedSizeAllocator<64> allocator;
+			allocator.init();
+
+			std::vector<void*> ptrs;
+			for (auto& value : smallInts) {
+				ptrs.push_back(allocator.alloc(value));
+			}
+			int pages_count = allocator.get_pages_count();
+
+			// another thread gives everything back without the lock
+			std::thread consumer([&]() {
+				for (auto& ptr : ptrs) {
+					allocator.free_remote(ptr);
+				}
+			});
+			consumer.join();
+
+			// the same blocks are taken again instead of new pages
+			for (size_t i = 0; i < ptrs.size(); ++i) {
+				ptrs[i] = allocator.alloc(smallInts[i]);
+			}
+			RC_ASSERT(allocator.get_pages_count() == pages_count);
+
+			for (auto& ptr : ptrs) {
+				allocator.free(ptr);
+			}
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("coalesed alllocator",
+		[]() {
+			const auto smallInts = *rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 30));
+			CoalesedAllocator allocator;
+			allocator.init();
+
+
+			std::vector<void*> ptrs;
+			for (auto& value : smallInts) {
+				ptrs.push_back(allocator.alloc(value));
+				RC_ASSERT(reinterpret_cast<uintptr_t>(ptrs.back()) % CoalesedAllocator::BlockAlignment == 0);
+			}
+			
+			auto rng = std::default_random_engine{};
+			std::shuffle(ptrs.begin(), ptrs.end(), rng);
+
+			for (auto& value : ptrs) {
+				// shouldn't assert that there are corrupted block
+				allocator.free(value);
+			}
+
+			// shouldn't assert that there are non freed blocks
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("coalesed alllocator merges freed blocks",
+		[]() {
+			const auto sizes = *rc::gen::container<std::vector<int>>(rc::gen::inRange(4097, 1024*1024));
+			const auto policy = *rc::gen::element(CoalesedAllocator::FitPolicy::SegregatedFit,
+				CoalesedAllocator::FitPolicy::BestFit, CoalesedAllocator::FitPolicy::AddressOrderedBestFit);
+			CoalesedAllocator allocator(policy);
+			allocator.init();
+
+			std::vector<unsigned char*> ptrs;
+			for (size_t i = 0; i < sizes.size(); ++i) {
+				ptrs.push_back(reinterpret_cast<unsigned char*>(allocator.alloc(sizes[i])));
+				std::fill(ptrs[i], ptrs[i] + sizes[i], static_cast<unsigned char>(i));
+			}
+			for (size_t i = 0; i < ptrs.size(); ++i) {
+				// blocks shouldn't overlap
+				RC_ASSERT(std::count(ptrs[i], ptrs[i] + sizes[i], static_cast<unsigned char>(i)) == sizes[i]);
+			}
+
+			auto rng = std::default_random_engine{};
+			std::shuffle(ptrs.begin(), ptrs.end(), rng);
+			for (auto& ptr : ptrs) {
+				allocator.free(ptr);
+			}
+
+			// every page is one free block again, so the biggest block fits without a new page
+			int pages_count = allocator.get_pages_count();
+			void* whole = allocator.alloc(1024*1024*10);
+			RC_ASSERT(allocator.get_pages_count() == std::max(pages_count, 1));
+			allocator.free(whole);
+
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("coalesed alllocator packs blocks",
+		[]() {
+			const auto sizes = *rc::gen::nonEmpty(rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 65536)));
+			CoalesedAllocator allocator;
+			allocator.init();
+
+			// blocks are cut one after another from the page, only the boundary tag lies between them
+			std::vector<void*> ptrs;
+			for (auto& size : sizes) {
+				ptrs.push_back(allocator.alloc(size));
+				RC_ASSERT(CoalesedAllocator::owner_of(ptrs.back()) == &allocator);
+			}
+			for (size_t i = 1; i < ptrs.size(); ++i) {
+				size_t size = std::max<size_t>((sizes[i - 1] + CoalesedAllocator::BlockAlignment - 1) & ~(CoalesedAllocator::BlockAlignment - 1), CoalesedAllocator::MinBlockSize);
+				RC_ASSERT(reinterpret_cast<uintptr_t>(ptrs[i]) - reinterpret_cast<uintptr_t>(ptrs[i - 1]) == size + CoalesedAllocator::BlockHeaderSize);
+			}
+
+			for (auto& ptr : ptrs) {
+				allocator.free(ptr);
+			}
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("coalesed alllocator commits on demand",
+		[]() {
+			const auto sizes = *rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 1024*1024));
+			CoalesedAllocator allocator;
+			allocator.init();
+
+			// nothing is mapped before the first block
+			RC_ASSERT(allocator.get_pages_count() == 0);
+			RC_ASSERT(allocator.get_committed_bytes() == 0u);
+
+			std::vector<unsigned char*> ptrs;
+			size_t used_size = 0;
+			for (size_t i = 0; i < sizes.size(); ++i) {
+				ptrs.push_back(reinterpret_cast<unsigned char*>(allocator.alloc(sizes[i])));
+				// the whole block is writable
+				std::fill(ptrs[i], ptrs[i] + sizes[i], static_cast<unsigned char>(i));
+				used_size += std::max<size_t>(sizes[i], CoalesedAllocator::MinBlockSize) + CoalesedAllocator::BlockAlignment + CoalesedAllocator::BlockHeaderSize;
+			}
+			// the blocks and the header of every page and a step at most over them
+			RC_ASSERT(allocator.get_committed_bytes() <= used_size + allocator.get_pages_count() * (CoalesedAllocator::PageHeaderSize + 3 * CoalesedCommitStep));
+
+			for (auto& ptr : ptrs) {
+				allocator.free(ptr);
+			}
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("coalesed alllocator purges big free blocks",
+		[]() {
+			const auto sizes = *rc::gen::nonEmpty(rc::gen::container<std::vector<int>>(rc::gen::inRange(4097, 1024*1024)));
+			CoalesedAllocator allocator;
+			allocator.set_purge_threshold(64*1024);
+			allocator.init();
+
+			std::vector<unsigned char*> ptrs;
+			size_t total_size = 0;
+			for (size_t i = 0; i < sizes.size(); ++i) {
+				ptrs.push_back(reinterpret_cast<unsigned char*>(allocator.alloc(sizes[i])));
+				std::fill(ptrs[i], ptrs[i] + sizes[i], static_cast<unsigned char>(i));
+				total_size += sizes[i];
+			}
+			RC_ASSERT(allocator.get_purged_bytes() == 0u);
+
+			// every other block is freed into a hole next to allocated ones, the rest merge with them
+			for (size_t i = 0; i < ptrs.size(); i += 2) {
+				allocator.free(ptrs[i]);
+			}
+			for (size_t i = 1; i < ptrs.size(); i += 2) {
+				// neighbours keep their contents
+				RC_ASSERT(std::count(ptrs[i], ptrs[i] + sizes[i], static_cast<unsigned char>(i)) == sizes[i]);
+				allocator.free(ptrs[i]);
+			}
+			// the dirty memory is purged once, less the partial pages at the ends of the blocks
+			RC_ASSERT(allocator.get_purged_bytes() <= total_size);
+			RC_ASSERT(allocator.get_purged_bytes() + sizes.size() * 3 * PageProvider::granularity() >= total_size);
+
+			// purged memory is usable again
+			auto* whole = reinterpret_cast<unsigned char*>(allocator.alloc(1024*1024*10));
+			std::fill(whole, whole + 1024*1024*10, static_cast<unsigned char>(1));
+			allocator.free(whole);
+
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("coalesed alllocator decays merged blocks once",
+		[]() {
+			const auto sizes = *rc::gen::nonEmpty(rc::gen::container<std::vector<int>>(rc::gen::inRange(4097, 1024*1024)));
+			CoalesedAllocator allocator;
+			allocator.set_purge_threshold(SIZE_MAX);
+			allocator.init();
+			// every free block is a decay time old after a tick
+			auto decay = [&]() {
+				size_t purged = 0;
+				while (allocator.decay(1, linear_decay, purged)) {
+				}
+				return purged;
+			};
+
+			std::vector<unsigned char*> ptrs;
+			size_t total_size = 0;
+			for (size_t i = 0; i < sizes.size(); ++i) {
+				ptrs.push_back(reinterpret_cast<unsigned char*>(allocator.alloc(sizes[i])));
+				std::fill(ptrs[i], ptrs[i] + sizes[i], static_cast<unsigned char>(i));
+				total_size += sizes[i];
+			}
+
+			// the purged holes merge with the blocks freed later, only these are purged by the next tick
+			for (size_t i = 0; i < ptrs.size(); i += 2) {
+				allocator.free(ptrs[i]);
+			}
+			size_t purged = decay();
+			for (size_t i = 1; i < ptrs.size(); i += 2) {
+				RC_ASSERT(std::count(ptrs[i], ptrs[i] + sizes[i], static_cast<unsigned char>(i)) == sizes[i]);
+				allocator.free(ptrs[i]);
+			}
+			purged += decay();
+			RC_ASSERT(purged == allocator.get_purged_bytes());
+			// merged blocks count their boundary tags and rounding too
+			RC_ASSERT(purged <= total_size + sizes.size() * (CoalesedAllocator::BlockHeaderSize + CoalesedAllocator::BlockAlignment));
+			RC_ASSERT(purged + sizes.size() * 3 * PageProvider::granularity() >= total_size);
+
+			// purged blocks are skipped from now on
+			RC_ASSERT(decay() == 0u);
+
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("coalesed alllocator resizes in place",
+		[]() {
+			const auto size = *rc::gen::inRange(1, 1024*1024);
+			const auto new_size = *rc::gen::inRange(1, 1024*1024);
+			CoalesedAllocator allocator;
+			allocator.init();
+
+			// the block is followed by the free rest of the page
+			auto* ptr = reinterpret_cast<unsigned char*>(allocator.alloc(size));
+			std::fill(ptr, ptr + size, static_cast<unsigned char>(1));
+			RC_ASSERT(allocator.resize(ptr, new_size));
+			RC_ASSERT(CoalesedAllocator::block_size(ptr) >= static_cast<size_t>(new_size));
+			RC_ASSERT(std::count(ptr, ptr + std::min(size, new_size), static_cast<unsigned char>(1)) == std::min(size, new_size));
+			std::fill(ptr, ptr + new_size, static_cast<unsigned char>(2));
+
+			// a block in use behind it stops the growth, but not the shrinking
+			void* guard = allocator.alloc(64);
+			RC_ASSERT(!allocator.resize(ptr, CoalesedAllocator::block_size(ptr) + 64));
+			RC_ASSERT(allocator.resize(ptr, 1));
+			RC_ASSERT(ptr[0] == 2);
+
+			// once the guard is gone the given back tail and the rest are one free block again
+			allocator.free(guard);
+			RC_ASSERT(allocator.resize(ptr, new_size));
+			RC_ASSERT(ptr[0] == 2);
+			allocator.free(ptr);
+			void* whole = allocator.alloc(1024*1024*10);
+			RC_ASSERT(allocator.get_pages_count() == 1);
+			allocator.free(whole);
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("coalesed alllocator best fit",
+		[]() {
+			const auto holes = *rc::gen::nonEmpty(rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 64)));
+			const bool address_ordered = *rc::gen::arbitrary<bool>();
+			CoalesedAllocator allocator(address_ordered ? CoalesedAllocator::FitPolicy::AddressOrderedBestFit : CoalesedAllocator::FitPolicy::BestFit);
+			allocator.init();
+
+			// holes of 4KB granularity, kept apart by allocated guards
+			std::vector<void*> hole_ptrs;
+			std::vector<void*> guards;
+			for (auto& hole : holes) {
+				hole_ptrs.push_back(allocator.alloc(hole * 4096));
+				guards.push_back(allocator.alloc(64));
+			}
+			for (auto& ptr : hole_ptrs) {
+				allocator.free(ptr);
+			}
+
+			// the free blocks: the holes, the rests of the pages after the last guard, which are neither a hole
+			// nor a guard nor the closing block, and the merges of both, where a guard went to another page;
+			// by address, with the order they were freed in, the rests were cut off before the holes were freed
+			std::map<unsigned char*, int> free_blocks;
+			for (size_t i = 0; i < hole_ptrs.size(); ++i) {
+				free_blocks[static_cast<unsigned char*>(hole_ptrs[i])] = static_cast<int>(i) + 1;
+			}
+			std::set<void*> guard_ptrs(guards.begin(), guards.end());
+			for (auto& guard : guards) {
+				auto* next = static_cast<unsigned char*>(guard) + CoalesedAllocator::block_size(guard) + CoalesedAllocator::BlockHeaderSize;
+				uintptr_t page = reinterpret_cast<uintptr_t>(guard) & ~(CoalesedPageAlignment - 1);
+				if (reinterpret_cast<uintptr_t>(next) != page + CoalesedPageSize && !guard_ptrs.count(next)) {
+					free_blocks.emplace(next, 0);
+				}
+			}
+			for (auto it = free_blocks.begin(); it != free_blocks.end() && std::next(it) != free_blocks.end();) {
+				auto next = std::next(it);
+				if (next->first < it->first + CoalesedAllocator::block_size(it->first)) {
+					it->second = std::max(it->second, next->second);
+					free_blocks.erase(next);
+				}
+				else {
+					++it;
+				}
+			}
+
+			// the smallest fitting block, the lowest or the last freed among equals
+			const size_t request = *rc::gen::inRange(1, *std::max_element(holes.begin(), holes.end()) + 1) * 4096;
+			size_t best_size = SIZE_MAX;
+			for (auto& block : free_blocks) {
+				size_t size = CoalesedAllocator::block_size(block.first);
+				if (size >= request) {
+					best_size = std::min(best_size, size);
+				}
+			}
+			std::vector<void*> expected;
+			int expected_order = -1;
+			for (auto& block : free_blocks) {
+				if (CoalesedAllocator::block_size(block.first) != best_size) {
+					continue;
+				}
+				if (address_ordered) {
+					if (expected.empty()) {
+						expected.push_back(block.first);
+					}
+				}
+				else if (block.second > expected_order) {
+					expected.assign(1, block.first);
+					expected_order = block.second;
+				}
+				else if (block.second == 0 && expected_order == 0) {
+					// rests of equal size were cut off in no particular order
+					expected.push_back(block.first);
+				}
+			}
+			void* ptr = allocator.alloc(request);
+			RC_ASSERT(std::find(expected.begin(), expected.end(), ptr) != expected.end());
+
+			allocator.free(ptr);
+			for (auto& guard : guards) {
+				allocator.free(guard);
+			}
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("alllocator",
+		[]() {
+			const auto smallInts = *rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 1024*1024*10));
+			MemoryAllocator allocator;
+			allocator.init();
+
+			// every tier aligns the blocks as malloc does, the smallest ones as much as fits them
+			std::vector<void*> ptrs;
+			for (auto& value : smallInts) {
+				ptrs.push_back(allocator.alloc(value));
+				size_t alignment = std::min(alignof(std::max_align_t), allocator.usable_size(ptrs.back()));
+				RC_ASSERT(reinterpret_cast<uintptr_t>(ptrs.back()) % alignment == 0);
+			}
+
+			auto rng = std::default_random_engine{};
+			std::shuffle(ptrs.begin(), ptrs.end(), rng);
+
+			for (auto& value : ptrs) {
+				// shouldn't assert that there are corrupted block
+				allocator.free(value);
+			}
+
+			// shouldn't assert that there are non freed blocks
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("alllocator realloc",
+		[]() {
+			const auto sizes = *rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 1024*1024*12));
+			MemoryAllocator allocator;
+			allocator.init();
+
+			// the contents survive every move, up to the smaller size
+			unsigned char* ptr = nullptr;
+			int size = 0;
+			for (size_t i = 0; i < sizes.size(); ++i) {
+				ptr = reinterpret_cast<unsigned char*>(allocator.realloc(ptr, sizes[i]));
+				int kept = std::min(size, sizes[i]);
+				RC_ASSERT(std::count(ptr, ptr + kept, static_cast<unsigned char>(i)) == kept);
+				size = sizes[i];
+				std::fill(ptr, ptr + size, static_cast<unsigned char>(i + 1));
+			}
+			if (ptr) {
+				RC_ASSERT(reinterpret_cast<uintptr_t>(allocator.realloc(ptr, 0)) == 0u);
+			}
+
+			// shouldn't assert that there are non freed blocks
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("alllocator realloc huge blocks",
+		[]() {
+			const auto sizes = *rc::gen::container<std::vector<size_t>>(4, rc::gen::inRange<size_t>(1024*1024*10 + 1, 1024*1024*64));
+			MemoryAllocator allocator;
+			allocator.init();
+
+			// huge blocks are remapped, every page of the kept part has to come along
+			unsigned char* ptr = nullptr;
+			size_t size = 0;
+			for (size_t i = 0; i < sizes.size(); ++i) {
+				ptr = reinterpret_cast<unsigned char*>(allocator.realloc(ptr, sizes[i]));
+				// the moved block is registered as a whole
+				RC_ASSERT(allocator.usable_size(ptr) >= sizes[i]);
+				RC_ASSERT(PageMap::instance().lookup(ptr + sizes[i] - 1).kind == PageMap::Kind::Huge);
+				size_t kept = std::min(size, sizes[i]);
+				for (size_t offset = 0; offset < kept; offset += 4096) {
+					RC_ASSERT(ptr[offset] == i);
+				}
+				if (kept) {
+					RC_ASSERT(ptr[kept - 1] == i);
+				}
+				size = sizes[i];
+				memset(ptr, static_cast<int>(i + 1), size);
+			}
+			allocator.free(ptr);
+
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("alllocator rejects sizes near SIZE_MAX",
+		[]() {
+			const auto slack = *rc::gen::inRange<size_t>(0, 2 * HugePageSize + 64);
+			MemoryAllocator::Options options;
+			options.huge_pages = *rc::gen::arbitrary<bool>();
+			MemoryAllocator allocator(options);
+			allocator.init();
+
+			// the mapping size would wrap around, nothing is mapped
+			RC_ASSERT(reinterpret_cast<uintptr_t>(allocator.alloc(SIZE_MAX - slack)) == 0u);
+
+			// a failed realloc leaves the block as it was
+			const size_t size = 1024*1024*20;
+			auto* ptr = reinterpret_cast<unsigned char*>(allocator.alloc(size));
+			std::fill(ptr, ptr + size, static_cast<unsigned char>(1));
+			size_t usable_size = allocator.usable_size(ptr);
+			RC_ASSERT(reinterpret_cast<uintptr_t>(allocator.realloc(ptr, SIZE_MAX - slack)) == 0u);
+			RC_ASSERT(allocator.usable_size(ptr) == usable_size);
+			RC_ASSERT(std::count(ptr, ptr + size, static_cast<unsigned char>(1)) == static_cast<ptrdiff_t>(size));
+			allocator.free(ptr);
+
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("alllocator caches huge mappings",
+		[]() {
+			const auto sizes = *rc::gen::container<std::vector<size_t>>(rc::gen::inRange<size_t>(1024*1024*10 + 1, 1024*1024*64));
+			const auto budget = *rc::gen::inRange<size_t>(0, 1024*1024*256);
+			MemoryAllocator::Options options;
+			options.huge_cache_bytes = budget;
+			options.huge_cache_age = std::chrono::milliseconds(60000);
+			MemoryAllocator allocator(options);
+			allocator.init();
+
+			std::vector<void*> ptrs;
+			for (size_t size : sizes) {
+				ptrs.push_back(allocator.alloc(size));
+			}
+			for (void* ptr : ptrs) {
+				allocator.free(ptr);
+			}
+			HugeCache::Stats stats = allocator.get_huge_cache_stats();
+			RC_ASSERT(stats.bytes <= budget);
+			RC_ASSERT(stats.mappings <= HugeCache::Capacity);
+
+			// the mapping freed last is the newest one, it is kept while it fits the budget with its header
+			if (!sizes.empty() && sizes.back() + 64 <= budget) {
+				void* ptr = allocator.alloc(sizes.back());
+				RC_ASSERT(std::find(ptrs.begin(), ptrs.end(), ptr) != ptrs.end());
+				RC_ASSERT(allocator.get_huge_cache_stats().hits == 1u);
+				allocator.free(ptr);
+			}
+
+			allocator.destroy();
+			RC_ASSERT(allocator.get_huge_cache_stats().mappings == 0);
+		}
+	);
+
+	ok &= rc::check("alllocator usable size",
+		[]() {
+			const auto sizes = *rc::gen::container<std::vector<size_t>>(rc::gen::inRange<size_t>(1, 1024*1024*12));
+			MemoryAllocator allocator;
+			allocator.init();
+
+			std::vector<void*> ptrs;
+			for (size_t size : sizes) {
+				void* ptr = allocator.alloc(size);
+				RC_ASSERT(allocator.usable_size(ptr) >= size);
+				if (size <= MaxFixedSize) {
+					// the slice of the pointer is its size class
+					RC_ASSERT(SlabRegion::instance().size_class_of(ptr) == size_class_of(size));
+					RC_ASSERT(allocator.usable_size(ptr) == SizeClasses[size_class_of(size)]);
+					// a page of the slice far past the ones in use, never committed
+					auto* unused_page = reinterpret_cast<unsigned char*>(fixed_size_page_of(ptr)) + 64 * SlabChunkSize;
+					RC_ASSERT(allocator.usable_size(unused_page + PageSize / 2) == 0u);
+				}
+				// only the start of a block is one
+				RC_ASSERT(allocator.usable_size(static_cast<unsigned char*>(ptr) + 1) == 0u);
+				ptrs.push_back(ptr);
+			}
+			for (auto& ptr : ptrs) {
+				allocator.free(ptr);
+				RC_ASSERT(allocator.usable_size(ptr) == 0u);
+			}
+
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("page map",
+		[]() {
+			const auto sizes = *rc::gen::container<std::vector<size_t>>(rc::gen::inRange<size_t>(1, 1024*1024*24));
+			MemoryAllocator allocator;
+			allocator.init();
+			PageMap& page_map = PageMap::instance();
+
+			// every byte of a block leads to the page it lives in
+			std::vector<unsigned char*> ptrs;
+			for (size_t size : sizes) {
+				auto* ptr = reinterpret_cast<unsigned char*>(allocator.alloc(size));
+				PageMap::Entry first = page_map.lookup(ptr);
+				PageMap::Entry last = page_map.lookup(ptr + size - 1);
+				RC_ASSERT(first.kind == last.kind);
+				RC_ASSERT(reinterpret_cast<uintptr_t>(first.metadata) == reinterpret_cast<uintptr_t>(last.metadata));
+				if (size <= MaxFixedSize) {
+					RC_ASSERT(first.kind == PageMap::Kind::FixedSize);
+					RC_ASSERT(reinterpret_cast<uintptr_t>(first.metadata) == reinterpret_cast<uintptr_t>(fixed_size_page_of(ptr)));
+				}
+				else if (size <= 1024*1024*10) {
+					RC_ASSERT(first.kind == PageMap::Kind::Coalesed);
+				}
+				else {
+					// the metadata of a huge block is the header in front of it
+					RC_ASSERT(first.kind == PageMap::Kind::Huge);
+					RC_ASSERT(ptr - static_cast<unsigned char*>(first.metadata) <= 64);
+				}
+				ptrs.push_back(ptr);
+			}
+
+			for (size_t i = 0; i < ptrs.size(); ++i) {
+				allocator.free(ptrs[i]);
+				if (sizes[i] > 1024*1024*10) {
+					// retired to the cache or unmapped
+					RC_ASSERT(page_map.lookup(ptrs[i]).kind == PageMap::Kind::None);
+				}
+			}
+
+			// memory the tiers haven't given out is told apart without reading it
+			int local = 0;
+			RC_ASSERT(page_map.lookup(&local).kind == PageMap::Kind::None);
+			RC_ASSERT(allocator.usable_size(&local) == 0u);
+			allocator.free(&local);
+#ifndef _DEBUG
+			// debug builds assert on it
+			RC_ASSERT(reinterpret_cast<uintptr_t>(allocator.realloc(&local, 100)) == 0u);
+			RC_ASSERT(local == 0);
+#endif
+
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("alllocator ignores frees of blocks it hasn't given out",
+		[]() {
+			const auto sizes = *rc::gen::nonEmpty(rc::gen::container<std::vector<size_t>>(rc::gen::inRange<size_t>(1, 1024*1024*24)));
+			const auto offset = *rc::gen::inRange<size_t>(1, 1024*1024*24);
+			MemoryAllocator::Options options;
+			options.thread_cache = *rc::gen::arbitrary<bool>();
+			MemoryAllocator allocator(options);
+			allocator.init();
+
+			std::vector<unsigned char*> ptrs;
+			for (size_t i = 0; i < sizes.size(); ++i) {
+				ptrs.push_back(reinterpret_cast<unsigned char*>(allocator.alloc(sizes[i])));
+				std::fill(ptrs[i], ptrs[i] + sizes[i], static_cast<unsigned char>(i));
+			}
+
+			// pointers into a block, its header and the page header in front of a fixed-size one
+			for (size_t i = 0; i < ptrs.size(); ++i) {
+				if (sizes[i] > 1) {
+					allocator.free(ptrs[i] + 1 + offset % (sizes[i] - 1));
+				}
+				if (sizes[i] <= MaxFixedSize) {
+					allocator.free(fixed_size_page_of(ptrs[i]));
+				}
+				else {
+					allocator.free(ptrs[i] - CoalesedAllocator::BlockHeaderSize);
+				}
+				RC_ASSERT(allocator.usable_size(ptrs[i]) >= sizes[i]);
+			}
+			// foreign memory
+			int local = 0;
+			auto heap = std::make_unique<int>(0);
+			allocator.free(&local);
+			allocator.free(heap.get());
+
+			// every other block is freed twice
+			for (size_t i = 0; i < ptrs.size(); i += 2) {
+				allocator.free(ptrs[i]);
+				allocator.free(ptrs[i]);
+			}
+
+			// the blocks taken again don't overlap the kept ones, and none of them is given out twice
+			std::vector<unsigned char*> new_ptrs;
+			for (size_t i = 0; i < ptrs.size(); i += 2) {
+				new_ptrs.push_back(reinterpret_cast<unsigned char*>(allocator.alloc(sizes[i])));
+				std::fill(new_ptrs.back(), new_ptrs.back() + sizes[i], static_cast<unsigned char>(0xff));
+			}
+			RC_ASSERT(std::set<unsigned char*>(new_ptrs.begin(), new_ptrs.end()).size() == new_ptrs.size());
+			for (size_t i = 1; i < ptrs.size(); i += 2) {
+				RC_ASSERT(std::count(ptrs[i], ptrs[i] + sizes[i], static_cast<unsigned char>(i)) == static_cast<std::ptrdiff_t>(sizes[i]));
+				allocator.free(ptrs[i]);
+			}
+			for (auto& ptr : new_ptrs) {
+				allocator.free(ptr);
+			}
+
+			// shouldn't assert that there are non freed blocks
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("size classes",
+		[]() {
+			const auto size = *rc::gen::inRange<size_t>(1, MaxFixedSize + 1);
+			int size_class = size_class_of(size);
+
+			// lookup tables agree with the search over the class table
+			RC_ASSERT(size_class == find_size_class(size));
+
+			// the smallest class which fits, wasting less than the alignment or a fifth of the slot
+			RC_ASSERT(SizeClasses[size_class] >= size);
+			if (size_class > 0) {
+				RC_ASSERT(SizeClasses[size_class - 1] < size);
+				RC_ASSERT(SizeClasses[size_class] % SizeClassAlignment == 0);
+			}
+			RC_ASSERT(SizeClasses[size_class] - size < std::max<size_t>(SizeClassAlignment, SizeClasses[size_class] / 5));
+		}
+	);
+
+	ok &= rc::check("alllocator small blocks",
+		[]() {
+			const auto smallInts = *rc::gen::container<std::vector<int>>(rc::gen::inRange(1, static_cast<int>(MaxFixedSize) + 1));
+			MemoryAllocator allocator;
+			allocator.init();
+
+			std::vector<unsigned char*> ptrs;
+			for (size_t i = 0; i < smallInts.size(); ++i) {
+				ptrs.push_back(reinterpret_cast<unsigned char*>(allocator.alloc(smallInts[i])));
+				std::fill(ptrs[i], ptrs[i] + smallInts[i], static_cast<unsigned char>(i));
+				// only the 8 byte class is below the malloc alignment
+				size_t alignment = smallInts[i] > 8 ? alignof(std::max_align_t) : 8;
+				RC_ASSERT(reinterpret_cast<uintptr_t>(ptrs[i]) % alignment == 0);
+			}
+
+			for (size_t i = 0; i < ptrs.size(); ++i) {
+				// blocks shouldn't overlap
+				RC_ASSERT(std::count(ptrs[i], ptrs[i] + smallInts[i], static_cast<unsigned char>(i)) == smallInts[i]);
+				allocator.free(ptrs[i]);
+			}
+
+			// shouldn't assert that there are non freed blocks
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("alllocator with thread caches",
+		[]() {
+			const auto smallInts = *rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 2048));
+			MemoryAllocator::Options options;
+			options.thread_cache = true;
+			MemoryAllocator allocator(options);
+			allocator.init();
+
+			constexpr int ThreadsCount = 4;
+			std::vector<void*> ptrs[ThreadsCount];
+			std::vector<std::thread> threads;
+			for (int t = 0; t < ThreadsCount; ++t) {
+				threads.emplace_back([&, t]() {
+					for (auto& value : smallInts) {
+						ptrs[t].push_back(allocator.alloc(value));
+					}
+				});
+			}
+			for (auto& thread : threads) {
+				thread.join();
+			}
+			threads.clear();
+
+			// every thread frees blocks of its neighbour, the caches are flushed on thread exit
+			for (int t = 0; t < ThreadsCount; ++t) {
+				threads.emplace_back([&, t]() {
+					for (auto& value : ptrs[(t + 1) % ThreadsCount]) {
+						allocator.free(value);
+					}
+				});
+			}
+			for (auto& thread : threads) {
+				thread.join();
+			}
+
+			// shouldn't assert that there are non freed blocks
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("concurrent alllocator",
+		[]() {
+			const auto sizes = *rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 8192));
+			MemoryAllocator::Options options;
+			options.concurrent = true;
+			MemoryAllocator allocator(options);
+			allocator.init();
+
+			// threads interleave allocs and frees of every tier
+			constexpr int ThreadsCount = 4;
+			std::atomic<bool> intact{ true };
+			std::vector<std::thread> threads;
+			for (int t = 0; t < ThreadsCount; ++t) {
+				threads.emplace_back([&, t]() {
+					std::vector<unsigned char*> ptrs;
+					for (size_t i = 0; i < sizes.size(); ++i) {
+						ptrs.push_back(reinterpret_cast<unsigned char*>(allocator.alloc(sizes[i])));
+						std::fill(ptrs[i], ptrs[i] + sizes[i], static_cast<unsigned char>(t));
+						if (i % 2) {
+							allocator.free(ptrs[i - 1]);
+							ptrs[i - 1] = nullptr;
+						}
+					}
+					for (size_t i = 0; i < ptrs.size(); ++i) {
+						if (ptrs[i]) {
+							if (std::count(ptrs[i], ptrs[i] + sizes[i], static_cast<unsigned char>(t)) != sizes[i]) {
+								intact = false;
+							}
+							allocator.free(ptrs[i]);
+						}
+					}
+				});
+			}
+			for (auto& thread : threads) {
+				thread.join();
+			}
+			// blocks of different threads shouldn't overlap
+			RC_ASSERT(intact.load());
+
+			// shouldn't assert that there are non freed blocks
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("concurrent alllocator releases pages freed by other threads",
+		[]() {
+			const auto size = *rc::gen::inRange<size_t>(1, MaxFixedSize + 1);
+			const auto pages = *rc::gen::inRange<size_t>(4, 32);
+			MemoryAllocator::Options options;
+			options.concurrent = true;
+			options.thread_cache = *rc::gen::arbitrary<bool>();
+			MemoryAllocator allocator(options);
+			allocator.init();
+
+			// a spike freed by another thread, so every free is a remote one
+			std::vector<void*> ptrs;
+			for (size_t i = 0; i < pages * (PageSize / SizeClasses[size_class_of(size)]); ++i) {
+				ptrs.push_back(allocator.alloc(size));
+			}
+			allocator.flush_thread_cache();
+			int spike_pages = allocator.get_arena_stats(0).fixed_size_pages;
+			std::thread([&]() {
+				for (auto& ptr : ptrs) {
+					allocator.free(ptr);
+				}
+			}).join();
+
+			// the pages are released without waiting for the next alloc, but for the ones kept for the next spike
+			MemoryAllocator::ArenaStats stats = allocator.get_arena_stats(0);
+			RC_ASSERT(stats.fixed_size_pages <= DefaultEmptyPagesLimit);
+			RC_ASSERT(stats.released_fixed_size_pages >= static_cast<size_t>(spike_pages - DefaultEmptyPagesLimit));
+
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("alllocator with huge pages",
+		[]() {
+			const auto count = *rc::gen::inRange<size_t>(0, 16);
+			const auto sizes = *rc::gen::container<std::vector<int>>(count, rc::gen::inRange(1024*32, 1024*1024*24));
+			MemoryAllocator::Options options;
+			options.huge_pages = true;
+			MemoryAllocator allocator(options);
+			allocator.init();
+
+			std::vector<unsigned char*> ptrs;
+			for (size_t i = 0; i < sizes.size(); ++i) {
+				auto* ptr = reinterpret_cast<unsigned char*>(allocator.alloc(sizes[i]));
+				if (sizes[i] > 1024*1024*10) {
+					// only the header is in front of a huge block in its huge page
+					RC_ASSERT((reinterpret_cast<uintptr_t>(ptr) & (HugePageSize - 1)) < 64u);
+				}
+				memset(ptr, static_cast<int>(i), sizes[i]);
+				ptrs.push_back(ptr);
+			}
+			for (size_t i = 0; i < ptrs.size(); ++i) {
+				RC_ASSERT(ptrs[i][0] == static_cast<unsigned char>(i));
+				RC_ASSERT(ptrs[i][sizes[i] - 1] == static_cast<unsigned char>(i));
+				allocator.free(ptrs[i]);
+			}
+
+			// shouldn't assert that there are non freed blocks
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("alllocator with purger",
+		[]() {
+			const auto sizes = *rc::gen::nonEmpty(rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 65536)));
+			MemoryAllocator::Options options;
+			options.concurrent = true;
+			MemoryAllocator allocator(options);
+			allocator.init();
+
+			Purger::Options purger_options;
+			purger_options.interval = std::chrono::milliseconds(1);
+			purger_options.decay_time = std::chrono::milliseconds(4);
+			RC_ASSERT(allocator.start_purger(purger_options));
+
+			std::vector<unsigned char*> ptrs;
+			for (size_t i = 0; i < sizes.size(); ++i) {
+				ptrs.push_back(reinterpret_cast<unsigned char*>(allocator.alloc(sizes[i])));
+				std::fill(ptrs[i], ptrs[i] + sizes[i], static_cast<unsigned char>(i));
+			}
+			for (size_t i = 0; i < ptrs.size(); ++i) {
+				// purging doesn't touch the blocks in use
+				RC_ASSERT(std::count(ptrs[i], ptrs[i] + sizes[i], static_cast<unsigned char>(i)) == sizes[i]);
+				allocator.free(ptrs[i]);
+			}
+
+			// a few decay times later nothing unused is left
+			int intervals = allocator.get_purger_stats().intervals;
+			while (allocator.get_purger_stats().intervals < intervals + 8) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			allocator.stop_purger();
+			MemoryAllocator::ArenaStats stats = allocator.get_arena_stats(0);
+			RC_ASSERT(stats.fixed_size_pages == 0);
+			RC_ASSERT(allocator.get_purger_stats().total_bytes >= stats.released_fixed_size_pages * PageSize);
+
+			// purged memory is usable again
+			void* ptr = allocator.alloc(sizes[0]);
+			std::fill(reinterpret_cast<unsigned char*>(ptr), reinterpret_cast<unsigned char*>(ptr) + sizes[0], static_cast<unsigned char>(1));
+			allocator.free(ptr);
+
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("alllocator trims when the purger stops",
+		[]() {
+			const auto sizes = *rc::gen::nonEmpty(rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 65536)));
+			MemoryAllocator::Options options;
+			options.concurrent = true;
+			MemoryAllocator allocator(options);
+			allocator.init();
+
+			// no tick comes before the purger is stopped
+			Purger::Options purger_options;
+			purger_options.interval = std::chrono::milliseconds(60000);
+			RC_ASSERT(allocator.start_purger(purger_options));
+
+			std::vector<unsigned char*> ptrs;
+			for (size_t i = 0; i < sizes.size(); ++i) {
+				ptrs.push_back(reinterpret_cast<unsigned char*>(allocator.alloc(sizes[i])));
+				std::fill(ptrs[i], ptrs[i] + sizes[i], static_cast<unsigned char>(i));
+			}
+			const size_t big_size = 1024*1024*2;
+			auto* big = reinterpret_cast<unsigned char*>(allocator.alloc(big_size));
+			std::fill(big, big + big_size, static_cast<unsigned char>(1));
+			for (auto& ptr : ptrs) {
+				allocator.free(ptr);
+			}
+			allocator.free(big);
+			RC_ASSERT(allocator.get_arena_stats(0).purged_coalesed_bytes == 0u);
+
+			// the tiers keep no more than they do without the purger
+			allocator.stop_purger();
+			RC_ASSERT(allocator.get_purger_stats().intervals == 0);
+			MemoryAllocator::ArenaStats stats = allocator.get_arena_stats(0);
+			RC_ASSERT(stats.fixed_size_pages <= DefaultEmptyPagesLimit * SizeClassesCount);
+			RC_ASSERT(stats.purged_coalesed_bytes + 3 * PageProvider::granularity() >= big_size);
+
+			allocator.destroy();
+		}
+	);
+
+	ok &= rc::check("alllocator with thread arenas",
+		[]() {
+			const auto smallInts = *rc::gen::container<std::vector<int>>(rc::gen::inRange(1, 2048));
+			MemoryAllocator::Options options;
+			options.thread_arenas = true;
+			MemoryAllocator allocator(options);
+			allocator.init();
+
+			constexpr int ThreadsCount = 4;
+			std::vector<void*> ptrs[ThreadsCount];
+			std::vector<std::thread> threads;
+			for (int t = 0; t < ThreadsCount; ++t) {
+				threads.emplace_back([&, t]() {
+					for (auto& value : smallInts) {
+						ptrs[t].push_back(allocator.alloc(value));
+					}
+				});
+			}
+			for (auto& thread : threads) {
+				thread.join();
+			}
+			threads.clear();
+			RC_ASSERT(allocator.get_arenas_count() <= ThreadsCount);
+
+			// new threads adopt the arenas of the exited ones and free blocks of their neighbours
+			for (int t = 0; t < ThreadsCount; ++t) {
+				threads.emplace_back([&, t]() {
+					for (auto& value : ptrs[(t + 1) % ThreadsCount]) {
+						allocator.free(value);
+					}
+				});
+			}
+			for (auto& thread : threads) {
+				thread.join();
+			}
+			// no more arenas than threads alive at once
+			RC_ASSERT(allocator.get_arenas_count() <= ThreadsCount);
+			for (int i = 0; i < allocator.get_arenas_count(); ++i) {
+				RC_ASSERT(allocator.get_arena_stats(i).threads_count == 0);
+			}
+
+			// an owned arena can't be taken by another thread
+			int arena = allocator.get_arena();
+			bool taken = true;
+			std::thread([&]() { taken = allocator.select_arena(arena); }).join();
+			RC_ASSERT(!taken);
+
+			// shouldn't assert that there are non freed blocks
+			allocator.destroy();
+		}
+	);
+
+	cout << "Hello CMake." << endl;
+	MemoryAllocator allocator;
+	allocator.init();
+
+	int* pi = reinterpret_cast<int*>(allocator.alloc(sizeof(int)));
+	double* pd = reinterpret_cast<double*>(allocator.alloc(sizeof(double)));
+	int* pa = reinterpret_cast<int*>(allocator.alloc(10 * sizeof(int)));
+	int* a = reinterpret_cast<int*>(allocator.alloc(256 * sizeof(int)));
+
+#ifdef _DEBUG
+	allocator.dumpStat();
+	allocator.dumpBlocks();
+#endif
+
+
+	allocator.free(a);
+	allocator.free(pa);
+	allocator.free(pd);
+	allocator.free(pi);
+
+	allocator.destroy();
+
+
+	/*
+	cout << "Hello CMake."  << endl;
+	FixedSizeAllocator<512> allocator;
+	allocator.init();
+
+	int* pi = reinterpret_cast<int*>(allocator.alloc(sizeof(int)));
+	double* pd = reinterpret_cast<double*>(allocator.alloc(sizeof(double)));
+	int* pa = reinterpret_cast<int*>(allocator.alloc(10 * sizeof(int)));
+
+	allocator.dumpStat();
+	allocator.dumpBlocks();
+
+	allocator.free(pa);
+	allocator.free(pd);
+	allocator.free(pi);
+
+	allocator.destroy();
+	*/
+
+	/*
+	CoalesedAllocator allocator;
+	allocator.init();
+
+	int* pi = reinterpret_cast<int*>(allocator.alloc(sizeof(int)));
+	double* pd = reinterpret_cast<double*>(allocator.alloc(sizeof(double)));
+	int* pa = reinterpret_cast<int*>(allocator.alloc(10 * sizeof(int)));
+
+	// allocator.dumpStat();
+	// allocator.dumpBlocks();
+
+	allocator.free(pa);
+	allocator.free(pd);
+	allocator.free(pi);
+
+	allocator.destroy();
+	*/
+	return ok ? 0 : 1;
+}
@@ -1,403 +1,1076 @@
-#pragma once
-
-#include <windows.h>
-#include <cassert>
-#include <cstddef>
-#include <iostream>
-
-constexpr size_t CoalesedPageSize = 1024*1024*11;
-
-class CoalesedAllocator
-{
-	class Page;
-
-#pragma pack(push, 8)
-	struct Bucket
-	{
-		Bucket(Bucket* prev_bucket, Bucket* prev_free_bucket, Page* page, size_t size)
-			: prev_bucket(prev_bucket), prev_free_bucket(prev_free_bucket), page(page), size(size)
-		{}
-
-#ifdef _DEBUG
-		long long red_zone = 0xDEADBEEF;
-#endif
-		Bucket* next_free_bucket = nullptr;
-		Bucket* prev_free_bucket;
-		Bucket* next_bucket = nullptr;
-		Bucket* prev_bucket;
-		Page* page;
-		size_t size;
-		bool freed = true;
-
-
-		int reserved_byte; // for detecting allocator
-	};
-#pragma pack(pop)
-
-#pragma pack(push, 8)
-	struct Page {
-		Page()
-		{
-			free_list_begin = reinterpret_cast<Bucket *>(reinterpret_cast<std::byte*>(this) + sizeof(Page));
-			Bucket* new_bucket = new (free_list_begin)Bucket(nullptr, nullptr, this, CoalesedPageSize - sizeof(Page) - sizeof(Bucket));
-		}
-
-		Page* next_page = nullptr;
-		Bucket* free_list_begin;
-	};
-#pragma pack(pop)
-
-public:
-	CoalesedAllocator() = default;
-	~CoalesedAllocator()
-	{
-#ifdef _DEBUG
-		assert(initialized);
-		assert(deinitialized);
-#endif
-	}
-
-	void init()
-	{
-#ifdef _DEBUG
-		assert(!initialized);
-		initialized = true;
-#endif
-
-		LPVOID new_page_ptr = VirtualAlloc(NULL, CoalesedPageSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-		Page* new_page = new (new_page_ptr) Page();
-		first_page = new_page;
-	}
-
-	void destroy()
-	{
-#ifdef _DEBUG
-		assert(initialized);
-		assert(!deinitialized);
-		deinitialized = true;
-
-		Page* page_it = first_page;
-		while (page_it) {
-			Bucket* it = reinterpret_cast<Bucket*>(reinterpret_cast<std::byte*>(page_it) + sizeof(Page));
-
-			assert(it->freed);
-			assert(!it->next_bucket);
-			page_it = page_it->next_page;
-		}
-#endif
-
-		destroy_i(first_page);
-	}
-
-	void* alloc(size_t size)
-	{
-#ifdef _DEBUG
-		assert(initialized);
-		assert(!deinitialized);
-#endif
-		Page* page_it = first_page;
-		Page* prev_page_it = nullptr;
-		while (page_it) {
-			Bucket* list_it = page_it->free_list_begin;
-			while (list_it) {
-				if (list_it->size >= size) {
-					// correct block!
-					return alloc_block(list_it, page_it, size);
-				}
-
-				list_it = list_it->next_bucket;
-			}
-
-			prev_page_it = page_it;
-			page_it = page_it->next_page;
-		}
-		// no free space, let's allocate new page
-		LPVOID new_page_ptr = VirtualAlloc(NULL, CoalesedPageSize, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
-		Page* new_page = new (new_page_ptr) Page();
-
-		if (prev_page_it) {
-			prev_page_it->next_page = new_page;
-		}
-		return alloc_block(new_page->free_list_begin, new_page, size);
-	}
-
-	void free(void* p)
-	{
-#ifdef _DEBUG
-		assert(initialized);
-		assert(!deinitialized);
-#endif
-		std::byte* bucket = reinterpret_cast<std::byte*>(p) - sizeof(Bucket);
-		Bucket* old_bucket = reinterpret_cast<Bucket*>(bucket);
-
-#ifdef _DEBUG
-		assert(old_bucket->red_zone == 0xDEADBEEF);
-#endif
-
-		if (old_bucket->prev_bucket && old_bucket->prev_bucket->freed) {
-			if (old_bucket->next_bucket && old_bucket->next_bucket->freed) {
-				// let's unite prev bucket with current
-				old_bucket->prev_bucket->size += sizeof(Bucket) + old_bucket->size;
-				old_bucket->prev_bucket->next_bucket = old_bucket->next_bucket;
-
-				if (old_bucket->next_bucket) {
-					old_bucket->next_bucket->prev_bucket = old_bucket->prev_bucket;
-				}
-				old_bucket = old_bucket->prev_bucket;
-
-
-				// it's needed to remove this block from free-list
-				if (old_bucket->next_bucket->prev_free_bucket) {
-					old_bucket->next_bucket->prev_free_bucket->next_free_bucket = old_bucket->next_bucket->next_free_bucket;
-				}
-				else {
-					old_bucket->page->free_list_begin = old_bucket->next_bucket->next_free_bucket;
-					if (old_bucket->next_bucket->next_free_bucket) {
-						old_bucket->next_bucket->next_free_bucket->prev_free_bucket = nullptr;
-					}
-				}
-
-				if (old_bucket->next_bucket->next_free_bucket) {
-					old_bucket->next_bucket->next_free_bucket->prev_free_bucket = old_bucket->next_bucket->prev_free_bucket;
-				}
-
-				// and then unite
-				old_bucket->size += sizeof(Bucket) + old_bucket->next_bucket->size;
-
-				if (old_bucket->next_bucket->next_bucket) {
-					old_bucket->next_bucket->next_bucket->prev_bucket = old_bucket;
-				}
-
-				old_bucket->next_bucket = old_bucket->next_bucket->next_bucket;
-			}
-			else {
-				// let's unite prev bucket with current
-				old_bucket->prev_bucket->size += sizeof(Bucket) + old_bucket->size;
-				old_bucket->prev_bucket->next_bucket = old_bucket->next_bucket;
-
-				if (old_bucket->next_bucket) {
-					old_bucket->next_bucket->prev_bucket = old_bucket->prev_bucket;
-				}
-				old_bucket = old_bucket->prev_bucket;
-			}
-		}
-		else {
-			if (old_bucket->next_bucket && old_bucket->next_bucket->freed) {
-				// let's steal data from next buffer
-
-				old_bucket->size += sizeof(Bucket) + old_bucket->next_bucket->size;
-				old_bucket->next_free_bucket = old_bucket->next_bucket->next_free_bucket;
-
-				if (old_bucket->next_bucket->next_free_bucket) {
-					old_bucket->next_bucket->next_free_bucket->prev_free_bucket = old_bucket;
-				}
-
-				old_bucket->prev_free_bucket = old_bucket->next_bucket->prev_free_bucket;
-
-				if (old_bucket->next_bucket->prev_free_bucket) {
-					old_bucket->next_bucket->prev_free_bucket->next_free_bucket = old_bucket;
-				}
-				else {
-					old_bucket->page->free_list_begin = old_bucket;
-				}
-
-				if (old_bucket->next_bucket->next_bucket) {
-					old_bucket->next_bucket->next_bucket->prev_bucket = old_bucket;
-				}
-				old_bucket->next_bucket = old_bucket->next_bucket->next_bucket;
-			}
-			else {
-				// just free - add ourself to free-list
-
-				old_bucket->next_free_bucket = old_bucket->page->free_list_begin;
-				old_bucket->prev_free_bucket = nullptr;
-				if (old_bucket->page->free_list_begin) {
-					old_bucket->page->free_list_begin->prev_free_bucket = old_bucket;
-				}
-				old_bucket->page->free_list_begin = old_bucket;
-			}
-		}
-		old_bucket->freed = true;
-	}
-
-#ifdef _DEBUG
-	int get_allocated_blocks() const
-	{
-		int total_blocks = 0;
-		int total_free_blocks = 0;
-
-		Page* page_it = first_page;
-		while (page_it) {
-			Bucket* it = reinterpret_cast<Bucket*>(reinterpret_cast<std::byte*>(page_it) + sizeof(Page));
-
-			int total_pages_blocks = 0;
-			int freed_blocks = 0;
-			while (it) {
-				++total_pages_blocks;
-				if (it->freed) {
-					++freed_blocks;
-				}
-				it = it->next_bucket;
-			}
-
-			total_free_blocks += freed_blocks;
-			total_blocks += total_pages_blocks;
-			page_it = page_it->next_page;
-		}
-
-		return total_blocks - total_free_blocks;
-	}
-
-	int get_freed_blocks() const
-	{
-		int total_free_blocks = 0;
-
-		Page* page_it = first_page;
-		while (page_it) {
-			Bucket* it = reinterpret_cast<Bucket*>(reinterpret_cast<std::byte*>(page_it) + sizeof(Page));
-
-			int freed_blocks = 0;
-			while (it) {
-				if (it->freed) {
-					++freed_blocks;
-				}
-				it = it->next_bucket;
-			}
-
-			total_free_blocks += freed_blocks;
-			page_it = page_it->next_page;
-		}
-
-		return total_free_blocks;
-	}
-
-	int get_pages_count() const
-	{
-		int pages_size = 0;
-
-		Page* page_it = first_page;
-		while (page_it) {
-			page_it = page_it->next_page;
-			++pages_size;
-		}
-
-		return pages_size;
-	}
-
-	void dumpStat() const
-	{
-		assert(initialized);
-		assert(!deinitialized);
-
-		int pages_size = 0;
-		int total_blocks = 0;
-		int total_free_blocks = 0;
-
-		Page* page_it = first_page;
-		while (page_it) {
-			// std::cout << "Page, size " << CoalesedPageSize << ", block statistics:" << std::endl;
-
-			Bucket* it = reinterpret_cast<Bucket*>(reinterpret_cast<std::byte*>(page_it) + sizeof(Page));
-
-			int total_pages_blocks = 0;
-			int freed_blocks = 0;
-			while (it) {
-				++total_pages_blocks;
-				if (it->freed) {
-					++freed_blocks;
-				}
-				it = it->next_bucket;
-			}
-
-			std::cout << "Total blocks: " << total_blocks << std::endl;
-			std::cout << "Freed blocks: " << freed_blocks << std::endl;
-			std::cout << "Allocated blocks: " << total_blocks - freed_blocks << std::endl << std::endl;
-
-			total_free_blocks += freed_blocks;
-			total_blocks += total_pages_blocks;
-			page_it = page_it->next_page;
-			++pages_size;
-		}
-
-		// std::cout << std::endl << "Total block statistics:" << std::endl;
-		// std::cout << "Total pages: " << pages_size << std::endl;
-		std::cout << "Total blocks: " << total_blocks << std::endl;
-		std::cout << "Freed blocks: " << total_free_blocks << std::endl;
-		std::cout << "Allocated blocks: " << total_blocks - total_free_blocks << std::endl << std::endl;
-
-		// TODO:        :     ,        
-	}
-
-	void dumpBlocks() const
-	{
-		assert(initialized);
-		assert(!deinitialized);
-
-		Page* page_it = first_page;
-		while (page_it) {
-			Bucket* it = reinterpret_cast<Bucket*>(reinterpret_cast<std::byte*>(page_it) + sizeof(Page));
-
-			while (it) {
-				if (!it->freed) {
-					std::cout << "size - " << it->size << std::endl;
-					std::cout << "ptr - " << it + sizeof(Bucket) << std::endl;
-				}
-				it = it->next_bucket;
-			}
-			page_it = page_it->next_page;
-		}
-	}
-#endif
-
-private:
-	void destroy_i(Page* page_it)
-	{
-		if (!page_it) {
-			return;
-		}
-		destroy_i(page_it->next_page);
-		VirtualFree(page_it, 0, MEM_RELEASE);
-	}
-
-	void* alloc_block(Bucket* list_it, Page* page, size_t size)
-	{
-		//let's try to split
-		if (list_it->size - size > sizeof(Bucket)) {
-			Bucket* new_bucket = new (reinterpret_cast<std::byte*>(list_it) + sizeof(Bucket) + size)Bucket(list_it, list_it->prev_free_bucket, page, list_it->size - size - sizeof(Bucket));
-			new_bucket->next_bucket = list_it->next_bucket;
-			if (list_it->next_bucket) {
-				list_it->next_bucket->prev_bucket = new_bucket;
-			}
-			list_it->next_bucket = new_bucket;
-
-			new_bucket->next_free_bucket = list_it->page->free_list_begin;
-			list_it->page->free_list_begin->prev_free_bucket = new_bucket;
-			list_it->page->free_list_begin = new_bucket;
-		}
-		else {
-			// diff is too small
-		}
-		list_it->size = size;
-		list_it->freed = false;
-
-		if (list_it->prev_free_bucket) {
-			list_it->prev_free_bucket->next_free_bucket = list_it->next_free_bucket;
-		}
-		else {
-			list_it->page->free_list_begin = list_it->next_free_bucket;
-		}
-
-		if (list_it->next_free_bucket) {
-			list_it->next_free_bucket->prev_free_bucket = list_it->prev_free_bucket;
-		}
-		// prev and next free buckets are invalidated
-
-		return reinterpret_cast<std::byte*>(list_it) + sizeof(Bucket);
-	}
-
-	Page* first_page;
-#ifdef _DEBUG
-	bool initialized = false;
-	bool deinitialized = false;
-#endif
+#pragma once
+
+#include "Bits.h"
+#include "PageMap.h"
+#include "PageProvider.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <vector>
+
+constexpr size_t CoalesedPageSize = 1024*1024*11;
+// pages are mapped at this alignment, the page of a block is found by masking its address
+constexpr size_t CoalesedPageAlignment = 1024*1024*16;
+
+static_assert(CoalesedPageSize <= CoalesedPageAlignment, "a page doesn't cross its alignment");
+
+// pages are reserved and committed in steps as the blocks reach further into them
+constexpr size_t CoalesedCommitStep = 64*1024;
+
+static_assert(CoalesedPageSize % CoalesedCommitStep == 0, "a page is committed in whole steps");
+static_assert(CoalesedPageAlignment % HugePageSize == 0, "huge pages don't cross pages");
+
+// free blocks at least this big give the memory of their interior back to the OS
+constexpr size_t DefaultPurgeThreshold = 1024*1024;
+
+// Free blocks of all pages are kept in one allocator-wide index, blocks are coalesced with their neighbours on free.
+// Blocks carry a 16 byte boundary tag, the links of the index live in the payload of free blocks only.
+// Big free blocks are purged: their whole pages stay mapped but aren't backed by memory until reused.
+// The default index is two-level segregated (TLSF): the first level is the power of two of the size,
+// the second splits it into SecondLevelCount bins, bitmaps of non-empty bins give a fitting bin in O(1).
+// The best-fit policies keep a size-ordered treap instead, linked through the payload of the free blocks.
+class CoalesedAllocator
+{
+public:
+	enum class FitPolicy {
+		SegregatedFit, // O(1), a fitting block of the bin, up to a bin width bigger than needed
+		BestFit, // the smallest fitting block, the most recently freed one among equals
+		AddressOrderedBestFit, // the smallest fitting block, the lowest one among equals
+	};
+
+private:
+	class Page;
+
+#pragma pack(push, 8)
+	// A free block repeats its size in prev_size of the next block,
+	// so both physical neighbours of a block are reached from its header.
+	struct Bucket
+	{
+		size_t prev_size; // valid while the previous block is free
+		uint32_t size_and_flags; // sizes are multiples of BlockAlignment, the low bits hold the flags below
+		int idle_ticks; // purger ticks since the block got free, while it's free
+	};
+#pragma pack(pop)
+
+	static constexpr uint32_t FreeFlag = 1;
+	static constexpr uint32_t PrevFreeFlag = 2;
+	static constexpr uint32_t FlagsMask = 3;
+
+	static_assert(sizeof(Bucket) == 16, "the boundary tag is the size of the previous block, the size with the flags and the age");
+	static_assert(CoalesedPageSize <= UINT32_MAX, "sizes fit the header");
+
+	// lives in the payload of a free block under the segregated fit policy
+	struct FreeLinks
+	{
+		Bucket* next_free_bucket;
+		Bucket* prev_free_bucket;
+	};
+
+	// lives in the payload of a free block under the best-fit policies
+	struct FreeNode
+	{
+		FreeNode* left;
+		FreeNode* right;
+		uintptr_t order; // second part of the key, ties of equal sizes are broken by it
+	};
+
+	// lives behind the index links of a free block: the hull of its parts which may still be backed by memory,
+	// offsets from the page start, and the bytes of these parts, all zero once purged. Merged blocks add up
+	// the bytes of their pieces, so the purged pieces in the hull aren't counted again.
+	struct DirtyRange
+	{
+		uint32_t begin;
+		uint32_t end;
+		uint32_t bytes;
+	};
+
+#pragma pack(push, 8)
+	struct Page {
+		Page(CoalesedAllocator* owner, size_t first_step)
+			: owner(owner), committed_end(reinterpret_cast<std::byte*>(this) + first_step)
+		{
+			// one free block over the page, closed by an empty allocated one, so every block has a next one
+			Bucket* bucket = first_bucket();
+			bucket->prev_size = 0;
+			bucket->size_and_flags = static_cast<uint32_t>(CoalesedPageSize - PageHeaderSize - 2 * sizeof(Bucket));
+			bucket->idle_ticks = 0;
+			Bucket* end = next_of(bucket);
+			end->prev_size = 0;
+			end->size_and_flags = 0;
+			end->idle_ticks = 0;
+			mark_free(bucket);
+			// fresh pages aren't touched yet
+			mark_purged(bucket);
+		}
+
+		Bucket* first_bucket()
+		{
+			return reinterpret_cast<Bucket*>(reinterpret_cast<std::byte*>(this) + PageHeaderSize);
+		}
+
+		// the last step is committed up front for the closing block
+		std::byte* tail_begin()
+		{
+			return reinterpret_cast<std::byte*>(this) + CoalesedPageSize - CoalesedCommitStep;
+		}
+
+		CoalesedAllocator* owner;
+		Page* next_page = nullptr;
+		std::byte* committed_end; // memory from the page start up to here and the tail step is committed
+		size_t reserved; // keeps the first header, and so every payload, aligned
+	};
+#pragma pack(pop)
+
+public:
+	// payloads are aligned as malloc ones, block sizes are its multiples
+	static constexpr size_t BlockAlignment = 16;
+	static constexpr size_t BlockHeaderSize = sizeof(Bucket);
+	// the live map follows the page header: a bit per BlockAlignment bytes of the page, set at the payloads given out,
+	// so a pointer into a page is told from a block without reading the memory it points at
+	static constexpr size_t LiveMapWords = CoalesedPageSize / BlockAlignment / 64;
+	static constexpr size_t PageHeaderSize = sizeof(Page) + LiveMapWords * sizeof(uint64_t);
+	// a freed block has to hold the links of the index and its dirty range
+	static constexpr size_t MinBlockSize = ((sizeof(FreeNode) > sizeof(FreeLinks) ? sizeof(FreeNode) : sizeof(FreeLinks)) + sizeof(DirtyRange) + BlockAlignment - 1) & ~(BlockAlignment - 1);
+	// the background purger walks about this many blocks under the lock at once, whole pages at least
+	static constexpr int PurgeBatchBlocks = 4096;
+
+	static_assert(BlockAlignment >= alignof(std::max_align_t), "payloads hold any fundamental type");
+	static_assert(PageHeaderSize % BlockAlignment == 0 && sizeof(Bucket) % BlockAlignment == 0, "headers keep the payloads aligned");
+
+	explicit CoalesedAllocator(FitPolicy policy = FitPolicy::SegregatedFit)
+		: policy(policy)
+	{}
+	~CoalesedAllocator()
+	{
+#ifdef _DEBUG
+		assert(initialized);
+		assert(deinitialized);
+#endif
+	}
+
+	// the first page is reserved by the first alloc
+	void init()
+	{
+#ifdef _DEBUG
+		assert(!initialized);
+		initialized = true;
+#endif
+	}
+
+	void destroy()
+	{
+#ifdef _DEBUG
+		assert(initialized);
+		assert(!deinitialized);
+		deinitialized = true;
+
+		Page* page_it = first_page;
+		while (page_it) {
+			Bucket* it = page_it->first_bucket();
+
+			assert(is_free(it));
+			assert(!size_of(next_of(it)));
+			page_it = page_it->next_page;
+		}
+#endif
+
+		destroy_i(first_page);
+		first_page = nullptr;
+		walk_cursor = nullptr;
+		pages_count.store(0, std::memory_order_relaxed);
+		committed_bytes.store(0, std::memory_order_relaxed);
+	}
+
+	void* alloc(size_t size)
+	{
+#ifdef _DEBUG
+		assert(initialized);
+		assert(!deinitialized);
+#endif
+		size = round_size(size);
+
+		Bucket* bucket = find_free_bucket(size);
+		if (!bucket) {
+			// no free space, let's allocate new page
+			Page* new_page = map_page();
+			if (!new_page) {
+				return nullptr;
+			}
+			insert_free_bucket(new_page->first_bucket());
+			bucket = find_free_bucket(size);
+			if (!bucket) {
+				return nullptr;
+			}
+		}
+
+		// the block and the head of the tail cut off it are going to be written
+		std::byte* used_end = payload_of(bucket) + size + sizeof(Bucket) + MinBlockSize;
+		if (!commit_through(page_of(bucket), std::min(used_end, reinterpret_cast<std::byte*>(next_of(bucket))))) {
+			return nullptr;
+		}
+
+		remove_free_bucket(bucket);
+		split(bucket, size, *dirty_range_of(bucket));
+		mark_used(bucket);
+		set_live(bucket, true);
+		return payload_of(bucket);
+	}
+
+	// pointers into the pages which aren't the payload of a live block are ignored
+	void free(void* p)
+	{
+#ifdef _DEBUG
+		assert(initialized);
+		assert(!deinitialized);
+#endif
+		if (!is_live(p)) {
+			return;
+		}
+		Bucket* bucket = header_of(p);
+		set_live(bucket, false);
+		free_bucket(bucket);
+	}
+
+	// resizes the block where it lies: grows it over a free next block or gives its tail back,
+	// false if it can't grow there
+	bool resize(void* p, size_t size)
+	{
+#ifdef _DEBUG
+		assert(initialized);
+		assert(!deinitialized);
+#endif
+		size = round_size(size);
+		Bucket* bucket = header_of(p);
+
+		if (size > size_of(bucket)) {
+			Bucket* next_bucket = next_of(bucket);
+			if (!is_free(next_bucket) || size_of(bucket) + sizeof(Bucket) + size_of(next_bucket) < size) {
+				return false;
+			}
+			std::byte* used_end = payload_of(bucket) + size + sizeof(Bucket) + MinBlockSize;
+			if (!commit_through(page_of(bucket), std::min(used_end, reinterpret_cast<std::byte*>(next_of(next_bucket))))) {
+				return false;
+			}
+
+			// the dirty range of the absorbed block is gone with its payload
+			DirtyRange dirty = *dirty_range_of(next_bucket);
+			remove_free_bucket(next_bucket);
+			absorb_next(bucket);
+			split(bucket, size, dirty);
+			mark_used(bucket);
+			return true;
+		}
+
+		if (size_of(bucket) - size < sizeof(Bucket) + MinBlockSize) {
+			// the tail is too small to be a block
+			return true;
+		}
+		// the tail becomes a block of its own, freeing it merges it with a free next block
+		Bucket* tail = reinterpret_cast<Bucket*>(payload_of(bucket) + size);
+		tail->size_and_flags = static_cast<uint32_t>(size_of(bucket) - size - sizeof(Bucket));
+		set_size(bucket, size);
+		free_bucket(tail);
+		return true;
+	}
+
+	// bytes the block can hold
+	static size_t block_size(const void* p)
+	{
+		return size_of(reinterpret_cast<const Bucket*>(reinterpret_cast<const std::byte*>(p) - sizeof(Bucket)));
+	}
+
+	// whether p is the payload of a block given out, p is in a page of an allocator;
+	// safe without the lock, only the live map is read
+	static bool is_live(const void* p)
+	{
+		uintptr_t offset = reinterpret_cast<uintptr_t>(p) - reinterpret_cast<uintptr_t>(page_of(p));
+		if (offset < PageHeaderSize + sizeof(Bucket) || offset >= CoalesedPageSize || offset % BlockAlignment) {
+			return false;
+		}
+		size_t index = offset / BlockAlignment;
+		return live_map_of(page_of(p))[index / 64].load(std::memory_order_relaxed) & (uint64_t(1) << (index % 64));
+	}
+
+#ifdef _DEBUG
+	int get_allocated_blocks() const
+	{
+		int total_blocks = 0;
+		int total_free_blocks = 0;
+
+		Page* page_it = first_page;
+		while (page_it) {
+			Bucket* it = page_it->first_bucket();
+
+			int total_pages_blocks = 0;
+			int freed_blocks = 0;
+			while (size_of(it)) {
+				++total_pages_blocks;
+				if (is_free(it)) {
+					++freed_blocks;
+				}
+				it = next_of(it);
+			}
+
+			total_free_blocks += freed_blocks;
+			total_blocks += total_pages_blocks;
+			page_it = page_it->next_page;
+		}
+
+		return total_blocks - total_free_blocks;
+	}
+
+	int get_freed_blocks() const
+	{
+		int total_free_blocks = 0;
+
+		Page* page_it = first_page;
+		while (page_it) {
+			Bucket* it = page_it->first_bucket();
+
+			int freed_blocks = 0;
+			while (size_of(it)) {
+				if (is_free(it)) {
+					++freed_blocks;
+				}
+				it = next_of(it);
+			}
+
+			total_free_blocks += freed_blocks;
+			page_it = page_it->next_page;
+		}
+
+		return total_free_blocks;
+	}
+
+	void dumpStat() const
+	{
+		assert(initialized);
+		assert(!deinitialized);
+
+		int pages_size = 0;
+		int total_blocks = 0;
+		int total_free_blocks = 0;
+
+		Page* page_it = first_page;
+		while (page_it) {
+			// std::cout << "Page, size " << CoalesedPageSize << ", block statistics:" << std::endl;
+
+			Bucket* it = page_it->first_bucket();
+
+			int total_pages_blocks = 0;
+			int freed_blocks = 0;
+			while (size_of(it)) {
+				++total_pages_blocks;
+				if (is_free(it)) {
+					++freed_blocks;
+				}
+				it = next_of(it);
+			}
+
+			std::cout << "Total blocks: " << total_blocks << std::endl;
+			std::cout << "Freed blocks: " << freed_blocks << std::endl;
+			std::cout << "Allocated blocks: " << total_blocks - freed_blocks << std::endl << std::endl;
+
+			total_free_blocks += freed_blocks;
+			total_blocks += total_pages_blocks;
+			page_it = page_it->next_page;
+			++pages_size;
+		}
+
+		// std::cout << std::endl << "Total block statistics:" << std::endl;
+		// std::cout << "Total pages: " << pages_size << std::endl;
+		std::cout << "Total blocks: " << total_blocks << std::endl;
+		std::cout << "Freed blocks: " << total_free_blocks << std::endl;
+		std::cout << "Allocated blocks: " << total_blocks - total_free_blocks << std::endl << std::endl;
+
+		// TODO: Выводит в стандартный поток вывода статистику по аллокатору: количество занятых и свободных блоков, список блоков запрошенных у ОС и их размеры
+	}
+
+	void dumpBlocks() const
+	{
+		assert(initialized);
+		assert(!deinitialized);
+
+		Page* page_it = first_page;
+		while (page_it) {
+			Bucket* it = page_it->first_bucket();
+
+			while (size_of(it)) {
+				if (!is_free(it)) {
+					std::cout << "size - " << size_of(it) << std::endl;
+					std::cout << "ptr - " << payload_of(it) << std::endl;
+				}
+				it = next_of(it);
+			}
+			page_it = page_it->next_page;
+		}
+	}
+#endif
+
+	// may be read while other threads allocate
+	int get_pages_count() const
+	{
+		return pages_count.load(std::memory_order_relaxed);
+	}
+
+	// bytes of the pages backed by the OS
+	size_t get_committed_bytes() const
+	{
+		return committed_bytes.load(std::memory_order_relaxed);
+	}
+
+	// bytes given back to the OS from free blocks since init, the same memory is counted every time it's purged
+	size_t get_purged_bytes() const
+	{
+		return purged_bytes.load(std::memory_order_relaxed);
+	}
+
+	void set_purge_threshold(size_t threshold)
+	{
+		purge_threshold = threshold;
+	}
+
+	// pages mapped from now on ask for huge pages and are committed in whole huge pages,
+	// so a committed part of a page is never left without one for want of the rest
+	void set_huge_pages(bool huge_pages)
+	{
+		this->huge_pages = huge_pages;
+		commit_step = huge_pages ? HugePageSize : CoalesedCommitStep;
+	}
+
+	// a tick of the background purger over the next batch of pages: free buckets which aren't purged get older,
+	// then the oldest ones are purged until the rest of the batch fits decay_curve of their age in decay ticks.
+	// Adds the bytes purged to purged, returns false once the tick has walked every page, so the lock
+	// can be dropped between the batches.
+	bool decay(int decay_ticks, double (*decay_curve)(double), size_t& purged)
+	{
+		std::vector<Bucket*> idle_buckets;
+		double kept_bytes = 0;
+		size_t idle_bytes = 0;
+		bool more = walk_dirty_batch([&](Bucket* bucket, size_t size) {
+			++bucket->idle_ticks;
+			kept_bytes += decay_curve(static_cast<double>(bucket->idle_ticks) / decay_ticks) * size;
+			idle_bytes += size;
+			idle_buckets.push_back(bucket);
+		});
+
+		std::stable_sort(idle_buckets.begin(), idle_buckets.end(), [](const Bucket* a, const Bucket* b) {
+			return a->idle_ticks > b->idle_ticks;
+		});
+		for (Bucket* bucket : idle_buckets) {
+			if (static_cast<double>(idle_bytes) <= std::ceil(kept_bytes)) {
+				break;
+			}
+			size_t size = purge_dirty(bucket);
+			idle_bytes -= size;
+			purged += size;
+		}
+		return more;
+	}
+
+	// once purging isn't deferred any more, purges the free buckets of the next batch of pages
+	// which the threshold would have purged on free; adds and returns as decay
+	bool trim(size_t& purged)
+	{
+		return walk_dirty_batch([&](Bucket* bucket, size_t /*size*/) {
+			if (size_of(bucket) >= purge_threshold) {
+				purged += purge_dirty(bucket);
+			}
+		});
+	}
+
+	// the allocator itself isn't synchronized, concurrent users share this lock
+	std::mutex& get_lock()
+	{
+		return tier_lock;
+	}
+
+	// allocator which gave the block out
+	static CoalesedAllocator* owner_of(void* p)
+	{
+		return page_of(p)->owner;
+	}
+
+private:
+	void destroy_i(Page* page_it)
+	{
+		if (!page_it) {
+			return;
+		}
+		destroy_i(page_it->next_page);
+		PageMap::instance().clear(page_it, CoalesedPageSize);
+		PageProvider::unmap(page_it, CoalesedPageSize);
+	}
+
+	Page* map_page()
+	{
+		std::byte* new_page_ptr = reinterpret_cast<std::byte*>(PageProvider::reserve_aligned(CoalesedPageSize, CoalesedPageAlignment));
+		if (!new_page_ptr) {
+			return nullptr;
+		}
+		if (huge_pages) {
+			PageProvider::advise_huge_pages(new_page_ptr, CoalesedPageSize);
+		}
+		// the header and the live map with the first block and the closing block, the rest follows the blocks;
+		// the live map reads as zeroes, no block is given out yet
+		size_t first_step = (PageHeaderSize + sizeof(Bucket) + MinBlockSize + commit_step - 1) & ~(commit_step - 1);
+		if (!PageProvider::commit(new_page_ptr, first_step)
+			|| !PageProvider::commit(new_page_ptr + CoalesedPageSize - CoalesedCommitStep, CoalesedCommitStep)
+			|| !PageMap::instance().set(new_page_ptr, CoalesedPageSize, PageMap::Kind::Coalesed, new_page_ptr)) {
+			PageMap::instance().clear(new_page_ptr, CoalesedPageSize);
+			PageProvider::unmap(new_page_ptr, CoalesedPageSize);
+			return nullptr;
+		}
+		committed_bytes.fetch_add(first_step + CoalesedCommitStep, std::memory_order_relaxed);
+
+		Page* new_page = new (new_page_ptr) Page(this, first_step);
+		new_page->next_page = first_page;
+		first_page = new_page;
+		pages_count.fetch_add(1, std::memory_order_relaxed);
+		return new_page;
+	}
+
+	static Page* page_of(const void* p)
+	{
+		return reinterpret_cast<Page*>(reinterpret_cast<uintptr_t>(p) & ~(CoalesedPageAlignment - 1));
+	}
+
+	// moves the committed end of the page past end in whole steps
+	bool commit_through(Page* page, std::byte* end)
+	{
+		if (end > page->tail_begin()) {
+			end = page->tail_begin();
+		}
+		if (end <= page->committed_end) {
+			return true;
+		}
+		size_t size = (end - page->committed_end + commit_step - 1) & ~(commit_step - 1);
+		size = std::min<size_t>(size, page->tail_begin() - page->committed_end);
+		if (!PageProvider::commit(page->committed_end, size)) {
+			return false;
+		}
+		page->committed_end += size;
+		committed_bytes.fetch_add(size, std::memory_order_relaxed);
+		return true;
+	}
+
+	// the block of a payload given out or a tail cut off one
+	void free_bucket(Bucket* bucket)
+	{
+#ifdef _DEBUG
+		assert(!is_free(bucket));
+		assert(!is_prev_free(next_of(bucket)));
+#endif
+
+		// the freed block and the dirty parts of its neighbours, the only memory which may need purging
+		DirtyRange dirty{ offset_in_page(bucket), offset_in_page(next_of(bucket)), 0 };
+		dirty.bytes = dirty.end - dirty.begin;
+
+		if (is_prev_free(bucket)) {
+			// let's unite prev bucket with current
+			Bucket* prev_bucket = prev_of(bucket);
+			if (!is_purged(prev_bucket)) {
+				dirty.begin = dirty_range_of(prev_bucket)->begin;
+				dirty.bytes += dirty_range_of(prev_bucket)->bytes;
+			}
+			remove_free_bucket(prev_bucket);
+			absorb_next(prev_bucket);
+			bucket = prev_bucket;
+		}
+		Bucket* next_bucket = next_of(bucket);
+		if (is_free(next_bucket)) {
+			// let's steal data from next buffer
+			if (!is_purged(next_bucket)) {
+				dirty.end = dirty_range_of(next_bucket)->end;
+				dirty.bytes += dirty_range_of(next_bucket)->bytes;
+			}
+			remove_free_bucket(next_bucket);
+			absorb_next(bucket);
+		}
+		mark_free(bucket);
+		set_dirty(bucket, dirty);
+		purge(bucket);
+		insert_free_bucket(bucket);
+	}
+
+	// keeps the headers and the payloads of split blocks aligned, leaves room for the index node once freed
+	static size_t round_size(size_t size)
+	{
+		size = (size + BlockAlignment - 1) & ~(BlockAlignment - 1);
+		return size < MinBlockSize ? MinBlockSize : size;
+	}
+
+	static size_t size_of(const Bucket* bucket)
+	{
+		return bucket->size_and_flags & ~FlagsMask;
+	}
+
+	static void set_size(Bucket* bucket, size_t size)
+	{
+		bucket->size_and_flags = static_cast<uint32_t>(size) | (bucket->size_and_flags & FlagsMask);
+	}
+
+	static bool is_free(const Bucket* bucket)
+	{
+		return bucket->size_and_flags & FreeFlag;
+	}
+
+	static bool is_prev_free(const Bucket* bucket)
+	{
+		return bucket->size_and_flags & PrevFreeFlag;
+	}
+
+	// only while the bucket is free
+	static bool is_purged(Bucket* bucket)
+	{
+		return !dirty_range_of(bucket)->bytes;
+	}
+
+	static std::byte* payload_of(Bucket* bucket)
+	{
+		return reinterpret_cast<std::byte*>(bucket) + sizeof(Bucket);
+	}
+
+	static Bucket* header_of(void* p)
+	{
+		return reinterpret_cast<Bucket*>(reinterpret_cast<std::byte*>(p) - sizeof(Bucket));
+	}
+
+	static Bucket* next_of(Bucket* bucket)
+	{
+		return reinterpret_cast<Bucket*>(payload_of(bucket) + size_of(bucket));
+	}
+
+	// only while the previous bucket is free
+	static Bucket* prev_of(Bucket* bucket)
+	{
+		return reinterpret_cast<Bucket*>(reinterpret_cast<std::byte*>(bucket) - bucket->prev_size - sizeof(Bucket));
+	}
+
+	// the next bucket keeps the size as the footer of this one
+	static void mark_free(Bucket* bucket)
+	{
+		bucket->size_and_flags |= FreeFlag;
+		bucket->idle_ticks = 0;
+		Bucket* next_bucket = next_of(bucket);
+		next_bucket->prev_size = size_of(bucket);
+		next_bucket->size_and_flags |= PrevFreeFlag;
+	}
+
+	static void mark_used(Bucket* bucket)
+	{
+		bucket->size_and_flags &= ~FreeFlag;
+		next_of(bucket)->size_and_flags &= ~PrevFreeFlag;
+	}
+
+	static DirtyRange* dirty_range_of(Bucket* bucket)
+	{
+		return reinterpret_cast<DirtyRange*>(payload_of(bucket) + MinBlockSize - sizeof(DirtyRange));
+	}
+
+	static uint32_t offset_in_page(const void* p)
+	{
+		return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(p) - reinterpret_cast<uintptr_t>(page_of(p)));
+	}
+
+	static std::atomic<uint64_t>* live_map_of(const Page* page)
+	{
+		return reinterpret_cast<std::atomic<uint64_t>*>(const_cast<Page*>(page) + 1);
+	}
+
+	// written under the lock, read by is_live without it
+	static void set_live(Bucket* bucket, bool live)
+	{
+		size_t index = offset_in_page(payload_of(bucket)) / BlockAlignment;
+		uint64_t bit = uint64_t(1) << (index % 64);
+		if (live) {
+			live_map_of(page_of(bucket))[index / 64].fetch_or(bit, std::memory_order_relaxed);
+		}
+		else {
+			live_map_of(page_of(bucket))[index / 64].fetch_and(~bit, std::memory_order_relaxed);
+		}
+	}
+
+	// the part of dirty inside the free bucket becomes its dirty range, with no more bytes than it spans
+	static void set_dirty(Bucket* bucket, DirtyRange dirty)
+	{
+		dirty.begin = std::max(dirty.begin, offset_in_page(bucket));
+		dirty.end = std::min(dirty.end, offset_in_page(next_of(bucket)));
+		if (dirty.begin >= dirty.end || !dirty.bytes) {
+			mark_purged(bucket);
+			return;
+		}
+		dirty.bytes = std::min(dirty.bytes, dirty.end - dirty.begin);
+		*dirty_range_of(bucket) = dirty;
+	}
+
+	static void mark_purged(Bucket* bucket)
+	{
+		*dirty_range_of(bucket) = DirtyRange{ 0, 0, 0 };
+	}
+
+	// purges a big free bucket on free
+	void purge(Bucket* bucket)
+	{
+		if (size_of(bucket) >= purge_threshold) {
+			purge_dirty(bucket);
+		}
+	}
+
+	// gives the dirty range of a free bucket back to the OS, returns the bytes purged
+	size_t purge_dirty(Bucket* bucket)
+	{
+		uintptr_t begin;
+		uintptr_t end;
+		size_t size = dirty_size_of(bucket, begin, end);
+		if (size) {
+			PageProvider::purge(reinterpret_cast<void*>(begin), end - begin);
+			purged_bytes.fetch_add(size, std::memory_order_relaxed);
+		}
+		mark_purged(bucket);
+		return size;
+	}
+
+	// calls f(bucket, size) for the free buckets of the next batch of pages with size dirty bytes to purge,
+	// false once the last page is walked, the next batch starts from the first page then
+	template <typename F>
+	bool walk_dirty_batch(F&& f)
+	{
+		// pages are only ever added in front, the ones mapped meanwhile are walked next time
+		Page* page_it = walk_cursor ? walk_cursor : first_page;
+		int blocks_count = 0;
+		for (; page_it && blocks_count < PurgeBatchBlocks; page_it = page_it->next_page) {
+			for (Bucket* it = page_it->first_bucket(); size_of(it); it = next_of(it)) {
+				++blocks_count;
+				if (!is_free(it) || is_purged(it)) {
+					continue;
+				}
+				uintptr_t begin;
+				uintptr_t end;
+				size_t size = dirty_size_of(it, begin, end);
+				if (size) {
+					f(it, size);
+				}
+			}
+		}
+		walk_cursor = page_it;
+		return page_it != nullptr;
+	}
+
+	// the whole committed pages of [dirty_begin, dirty_end) inside a free bucket,
+	// the index links at the start of the payload and the boundary tags stay resident
+	static size_t interior_of(Bucket* bucket, std::byte* dirty_begin, std::byte* dirty_end, uintptr_t& begin, uintptr_t& end)
+	{
+		Page* page = page_of(bucket);
+		if (page->committed_end < page->tail_begin() && dirty_end > page->committed_end) {
+			dirty_end = page->committed_end;
+		}
+
+		size_t granularity = PageProvider::granularity();
+		begin = reinterpret_cast<uintptr_t>(dirty_begin);
+		uintptr_t links_end = reinterpret_cast<uintptr_t>(payload_of(bucket) + MinBlockSize);
+		if (begin < links_end) {
+			begin = links_end;
+		}
+		begin = (begin + granularity - 1) & ~(granularity - 1);
+		end = reinterpret_cast<uintptr_t>(dirty_end) & ~(granularity - 1);
+		return begin < end ? end - begin : 0;
+	}
+
+	// the dirty bytes of a free bucket purging [begin, end) gives back, the purged pieces of its hull aside
+	static size_t dirty_size_of(Bucket* bucket, uintptr_t& begin, uintptr_t& end)
+	{
+		std::byte* page = reinterpret_cast<std::byte*>(page_of(bucket));
+		const DirtyRange* dirty = dirty_range_of(bucket);
+		size_t size = interior_of(bucket, page + dirty->begin, page + dirty->end, begin, end);
+		return std::min<size_t>(size, dirty->bytes);
+	}
+
+	// cuts the tail off the bucket if it's big enough to be a block,
+	// the tail keeps the part of the dirty range of the whole block which falls into it
+	void split(Bucket* bucket, size_t size, DirtyRange dirty)
+	{
+		if (size_of(bucket) - size < sizeof(Bucket) + MinBlockSize) {
+			// diff is too small, the whole block is given away
+			return;
+		}
+
+		// only the page of the new header gets touched, the tail stays purged where it was
+		Bucket* new_bucket = reinterpret_cast<Bucket*>(payload_of(bucket) + size);
+		new_bucket->size_and_flags = static_cast<uint32_t>(size_of(bucket) - size - sizeof(Bucket));
+		new_bucket->idle_ticks = 0;
+		set_size(bucket, size);
+		mark_free(new_bucket);
+		set_dirty(new_bucket, dirty);
+
+		insert_free_bucket(new_bucket);
+	}
+
+	// glues the physically next bucket to this one
+	static void absorb_next(Bucket* bucket)
+	{
+		set_size(bucket, size_of(bucket) + sizeof(Bucket) + size_of(next_of(bucket)));
+	}
+
+	static constexpr int SecondLevelLog2 = 4;
+	static constexpr int SecondLevelCount = 1 << SecondLevelLog2;
+	static constexpr int SmallBucketLog2 = 7; // smaller buckets are binned linearly on the first level 0
+	static constexpr size_t SmallBucketSize = size_t(1) << SmallBucketLog2;
+	static constexpr int FirstLevelCount = 24;
+
+	static_assert(SmallBucketSize / SecondLevelCount >= alignof(Bucket), "small bins are at least the size granularity apart");
+	static_assert((size_t(1) << (FirstLevelCount + SmallBucketLog2 - 2)) > CoalesedPageSize, "a whole page fits into the first level index");
+
+	static void bin_of(size_t size, int& first_level, int& second_level)
+	{
+		if (size < SmallBucketSize) {
+			first_level = 0;
+			second_level = static_cast<int>(size / (SmallBucketSize / SecondLevelCount));
+			return;
+		}
+		int log2 = floor_log2(size);
+		first_level = log2 - SmallBucketLog2 + 1;
+		second_level = static_cast<int>(size >> (log2 - SecondLevelLog2)) - SecondLevelCount;
+	}
+
+	Bucket* find_free_bucket(size_t size)
+	{
+		if (policy == FitPolicy::SegregatedFit) {
+			return find_in_bins(size);
+		}
+		return find_in_tree(size);
+	}
+
+	void insert_free_bucket(Bucket* bucket)
+	{
+		if (policy == FitPolicy::SegregatedFit) {
+			insert_into_bins(bucket);
+			return;
+		}
+		FreeNode* node = node_of(bucket);
+		node->left = nullptr;
+		node->right = nullptr;
+		// the newest block goes first among the equal ones, unless they are ordered by address
+		node->order = policy == FitPolicy::BestFit ? ~(free_sequence++) : reinterpret_cast<uintptr_t>(bucket);
+		tree_root = tree_insert(tree_root, node);
+	}
+
+	void remove_free_bucket(Bucket* bucket)
+	{
+		if (policy == FitPolicy::SegregatedFit) {
+			remove_from_bins(bucket);
+			return;
+		}
+		tree_root = tree_erase(tree_root, node_of(bucket));
+	}
+
+	// a free bucket of at least size bytes, from the first bin where every bucket fits
+	Bucket* find_in_bins(size_t size)
+	{
+		if (size >= SmallBucketSize) {
+			size += (size_t(1) << (floor_log2(size) - SecondLevelLog2)) - 1;
+		}
+		int first_level;
+		int second_level;
+		bin_of(size, first_level, second_level);
+		if (first_level >= FirstLevelCount) {
+			return nullptr;
+		}
+
+		uint32_t second_level_map = second_level_bitmaps[first_level] & (~uint32_t(0) << second_level);
+		if (!second_level_map) {
+			uint32_t first_level_map = first_level + 1 < FirstLevelCount ? first_level_bitmap & (~uint32_t(0) << (first_level + 1)) : 0;
+			if (!first_level_map) {
+				return nullptr;
+			}
+			first_level = lowest_bit(first_level_map);
+			second_level_map = second_level_bitmaps[first_level];
+		}
+		return free_lists[first_level][lowest_bit(second_level_map)];
+	}
+
+	void insert_into_bins(Bucket* bucket)
+	{
+		int first_level;
+		int second_level;
+		bin_of(size_of(bucket), first_level, second_level);
+
+		Bucket*& head = free_lists[first_level][second_level];
+		FreeLinks* links = links_of(bucket);
+		links->prev_free_bucket = nullptr;
+		links->next_free_bucket = head;
+		if (head) {
+			links_of(head)->prev_free_bucket = bucket;
+		}
+		head = bucket;
+
+		first_level_bitmap |= uint32_t(1) << first_level;
+		second_level_bitmaps[first_level] |= uint32_t(1) << second_level;
+	}
+
+	void remove_from_bins(Bucket* bucket)
+	{
+		int first_level;
+		int second_level;
+		bin_of(size_of(bucket), first_level, second_level);
+
+		FreeLinks* links = links_of(bucket);
+		if (links->prev_free_bucket) {
+			links_of(links->prev_free_bucket)->next_free_bucket = links->next_free_bucket;
+		}
+		else {
+			free_lists[first_level][second_level] = links->next_free_bucket;
+			if (!links->next_free_bucket) {
+				second_level_bitmaps[first_level] &= ~(uint32_t(1) << second_level);
+				if (!second_level_bitmaps[first_level]) {
+					first_level_bitmap &= ~(uint32_t(1) << first_level);
+				}
+			}
+		}
+		if (links->next_free_bucket) {
+			links_of(links->next_free_bucket)->prev_free_bucket = links->prev_free_bucket;
+		}
+		// prev and next free buckets are invalidated
+	}
+
+	static FreeLinks* links_of(Bucket* bucket)
+	{
+		return reinterpret_cast<FreeLinks*>(payload_of(bucket));
+	}
+
+	static FreeNode* node_of(Bucket* bucket)
+	{
+		return reinterpret_cast<FreeNode*>(payload_of(bucket));
+	}
+
+	static Bucket* bucket_of(FreeNode* node)
+	{
+		return reinterpret_cast<Bucket*>(reinterpret_cast<std::byte*>(node) - sizeof(Bucket));
+	}
+
+	// keys are (size, order)
+	static bool tree_less(FreeNode* a, FreeNode* b)
+	{
+		size_t a_size = size_of(bucket_of(a));
+		size_t b_size = size_of(bucket_of(b));
+		return a_size < b_size || (a_size == b_size && a->order < b->order);
+	}
+
+	// heap priority of the treap, a hash of the address keeps the tree balanced on average
+	static uint32_t tree_priority(FreeNode* node)
+	{
+		return static_cast<uint32_t>((static_cast<uint64_t>(reinterpret_cast<uintptr_t>(node)) * 0x9E3779B97F4A7C15ull) >> 32);
+	}
+
+	// the smallest key with at least size bytes
+	Bucket* find_in_tree(size_t size)
+	{
+		FreeNode* best = nullptr;
+		FreeNode* node = tree_root;
+		while (node) {
+			if (size_of(bucket_of(node)) >= size) {
+				best = node;
+				node = node->left;
+			}
+			else {
+				node = node->right;
+			}
+		}
+		return best ? bucket_of(best) : nullptr;
+	}
+
+	// nodes less than key go left
+	static void tree_split(FreeNode* root, FreeNode* key, FreeNode*& left, FreeNode*& right)
+	{
+		if (!root) {
+			left = nullptr;
+			right = nullptr;
+			return;
+		}
+		if (tree_less(root, key)) {
+			tree_split(root->right, key, root->right, right);
+			left = root;
+		}
+		else {
+			tree_split(root->left, key, left, root->left);
+			right = root;
+		}
+	}
+
+	static FreeNode* tree_merge(FreeNode* left, FreeNode* right)
+	{
+		if (!left || !right) {
+			return left ? left : right;
+		}
+		if (tree_priority(left) > tree_priority(right)) {
+			left->right = tree_merge(left->right, right);
+			return left;
+		}
+		right->left = tree_merge(left, right->left);
+		return right;
+	}
+
+	static FreeNode* tree_insert(FreeNode* root, FreeNode* node)
+	{
+		if (!root) {
+			return node;
+		}
+		if (tree_priority(node) > tree_priority(root)) {
+			tree_split(root, node, node->left, node->right);
+			return node;
+		}
+		if (tree_less(node, root)) {
+			root->left = tree_insert(root->left, node);
+		}
+		else {
+			root->right = tree_insert(root->right, node);
+		}
+		return root;
+	}
+
+	static FreeNode* tree_erase(FreeNode* root, FreeNode* node)
+	{
+		if (root == node) {
+			return tree_merge(root->left, root->right);
+		}
+		if (tree_less(node, root)) {
+			root->left = tree_erase(root->left, node);
+		}
+		else {
+			root->right = tree_erase(root->right, node);
+		}
+		return root;
+	}
+
+	Page* first_page = nullptr;
+	Page* walk_cursor = nullptr; // the page the next batch of the purger starts from, nullptr for the first one
+	std::atomic<int> pages_count{ 0 };
+	std::atomic<size_t> purged_bytes{ 0 };
+	std::atomic<size_t> committed_bytes{ 0 };
+	size_t purge_threshold = DefaultPurgeThreshold;
+	bool huge_pages = false;
+	size_t commit_step = CoalesedCommitStep; // a power of two
+
+	FitPolicy policy;
+
+	Bucket* free_lists[FirstLevelCount][SecondLevelCount] = {};
+	uint32_t first_level_bitmap = 0;
+	uint32_t second_level_bitmaps[FirstLevelCount] = {};
+
+	FreeNode* tree_root = nullptr;
+	uintptr_t free_sequence = 0;
+
+	std::mutex tier_lock;
+
+#ifdef _DEBUG
+	bool initialized = false;
+	bool deinitialized = false;
+#endif
 };
\ No newline at end of file
@@ -1,337 +1,600 @@
-#pragma once
-
-#include <windows.h>
-#include <cassert>
-#include <cstddef>
-
-constexpr size_t PageSize = 4096;
-
-template<int AllocSize>
-class FixedSizeAllocator
-{
-private:
-#pragma pack(push, 8)
-	struct Page {
-		Page* next_page = nullptr;
-		int free_list_begin_index = -1;
-		int initialized_buckets = 0;
-	};
-#pragma pack(pop)
-
-#pragma pack(push, 8)
-	struct Bucket {
-#ifdef _DEBUG
-		Bucket(int next_index, size_t size)
-			: next_index(next_index), size(size)
-		{}
-#else
-		Bucket(int next_index)
-			: next_index(next_index)
-		{}
-#endif
-
-#ifdef _DEBUG
-		long long magic_number = 0xDEADBEEF;
-		size_t size;
-#endif
-
-		int next_index;
-
-		int reserved_byte; // for detecting allocator
-	};
-#pragma pack(pop)
-
-public:
-	FixedSizeAllocator() = default;
-	~FixedSizeAllocator()
-	{
-#ifdef _DEBUG
-		assert(initialized);
-		assert(deinitialized);
-#endif
-	}
-
-	void init()
-	{
-		LPVOID new_page_ptr = VirtualAlloc(NULL, PageSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-		Page* new_page = new (new_page_ptr) Page();
-		first_page = new_page;
-
-#ifdef _DEBUG
-		assert(!initialized);
-		initialized = true;
-#endif
-	}
-
-	void destroy()
-	{
-#ifdef _DEBUG
-		assert(initialized);
-		assert(!deinitialized);
-		deinitialized = true;
-
-		Page* page_it = first_page;
-		while (page_it) {
-			int index = page_it->free_list_begin_index;
-			int freed_blocks = 0;
-			while (index != -1) {
-				std::byte* bucket = reinterpret_cast<std::byte*>(page_it) + sizeof(Page) + (BucketSize * index);
-				Bucket* old_bucket = reinterpret_cast<Bucket*>(bucket);
-				++freed_blocks;
-				index = old_bucket->next_index;
-			}
-			assert(page_it->initialized_buckets == freed_blocks);
-
-			page_it = page_it->next_page;
-		}
-#endif
-
-		destroy_i(first_page);
-	}
-
-	inline static auto BucketSize = AllocSize + sizeof(Bucket);
-	inline static auto BucketsInPage = (PageSize - sizeof(Page)) / BucketSize;
-
-	void* alloc(size_t size)
-	{
-#ifdef _DEBUG
-		assert(initialized);
-		assert(!deinitialized);
-#endif
-		Page* page_it = first_page;
-		Page* prev_page_it = nullptr;
-		while (page_it) {
-			if (page_it->initialized_buckets < BucketsInPage) {
-				return allocate_uninitialized_bucket(page_it, size);
-			}
-			else if (page_it->free_list_begin_index != -1) {
-				std::byte* bucket_ptr = reinterpret_cast<std::byte*>(page_it) + sizeof(Page) + (BucketSize * page_it->free_list_begin_index);
-				Bucket* bucket = reinterpret_cast<Bucket*>(bucket_ptr);
-				int cpy = bucket->next_index;
-				bucket->next_index = page_it->free_list_begin_index; // allocated block, let's write own index here
-				page_it->free_list_begin_index = cpy;
-
-#ifdef _DEBUG
-				bucket->size = size;
-#endif
-
-				return bucket + sizeof(Bucket);
-			}
-			else {
-				prev_page_it = page_it;
-				page_it = page_it->next_page;
-			}
-		}
-		// no free space, let's allocate new page
-		LPVOID new_page_ptr = VirtualAlloc(NULL, PageSize, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
-		Page* new_page = new (new_page_ptr) Page();
-
-		if (prev_page_it) {
-			prev_page_it->next_page = new_page;
-		}
-
-		return allocate_uninitialized_bucket(new_page, size);
-	}
-
-	void free(void* p)
-	{
-#ifdef _DEBUG
-		assert(initialized);
-		assert(!deinitialized);
-#endif
-		std::byte* bucket = reinterpret_cast<std::byte*>(p) - sizeof(Bucket);
-		Bucket* old_bucket = reinterpret_cast<Bucket*>(bucket);
-
-#ifdef _DEBUG
-		assert(old_bucket->magic_number == 0xDEADBEEF);
-#endif
-
-		int own_index = old_bucket->next_index; // we write own index in free-list cell on allocation
-
-		std::byte* page_ptr = bucket - (BucketSize * own_index) - sizeof(Page);
-		Page* page = reinterpret_cast<Page*>(page_ptr);
-
-		old_bucket->next_index = page->free_list_begin_index;
-		page->free_list_begin_index = own_index;
-	}
-
-#ifdef _DEBUG
-	int get_allocated_blocks() const
-	{
-		int pages_size = 0;
-		int total_free_blocks = 0;
-		int total_uninitialized_blocks = 0;
-
-		Page* page_it = first_page;
-		while (page_it) {
-			int index = page_it->free_list_begin_index;
-			int freed_blocks = 0;
-
-			while (index != -1) {
-				std::byte* bucket = reinterpret_cast<std::byte*>(page_it) + sizeof(Page) + (BucketSize * index);
-				Bucket* old_bucket = reinterpret_cast<Bucket*>(bucket);
-				++freed_blocks;
-				index = old_bucket->next_index;
-			}
-
-			total_free_blocks += freed_blocks;
-			total_uninitialized_blocks += BucketsInPage - page_it->initialized_buckets;
-			page_it = page_it->next_page;
-			++pages_size;
-		}
-
-		return (BucketsInPage * pages_size) - total_free_blocks - total_uninitialized_blocks;
-	}
-
-	int get_freed_blocks() const
-	{
-		int total_free_blocks = 0;
-
-		Page* page_it = first_page;
-		while (page_it) {
-			int index = page_it->free_list_begin_index;
-			int freed_blocks = 0;
-			while (index != -1) {
-				std::byte* bucket = reinterpret_cast<std::byte*>(page_it) + sizeof(Page) + (BucketSize * index);
-				Bucket* old_bucket = reinterpret_cast<Bucket*>(bucket);
-				++freed_blocks;
-				index = old_bucket->next_index;
-			}
-
-			total_free_blocks += freed_blocks;
-			page_it = page_it->next_page;
-		}
-
-		return total_free_blocks;
-	}
-
-	int get_uninitialized_blocks() const
-	{
-		int total_uninitialized_blocks = 0;
-
-		Page* page_it = first_page;
-		while (page_it) {
-			total_uninitialized_blocks += BucketsInPage - page_it->initialized_buckets;
-			page_it = page_it->next_page;
-		}
-
-		return total_uninitialized_blocks;
-	}
-
-	int get_pages_count() const
-	{
-		int pages_size = 0;
-
-		Page* page_it = first_page;
-		while (page_it) {
-			page_it = page_it->next_page;
-			++pages_size;
-		}
-
-		return pages_size;
-	}
-
-	void dumpStat() const
-	{
-		assert(initialized);
-		assert(!deinitialized);
-
-		int pages_size = 0;
-		int total_blocks = 0;
-		int total_free_blocks = 0;
-		int total_uninitialized_blocks = 0;
-
-		std::cout << "Blocks: " << AllocSize << std::endl;
-		Page* page_it = first_page;
-		while (page_it) {
-			//std::cout << "Page, size " << PageSize << ", block statistics:" << std::endl;
-			// std::cout << "Total blocks: " << BucketsInPage << std::endl;
-			// std::cout << "Uninitialized blocks: " << BucketsInPage - page_it->initialized_buckets << std::endl;
-
-			int index = page_it->free_list_begin_index;
-			int freed_blocks = 0;
-			while (index != -1) {
-				std::byte* bucket = reinterpret_cast<std::byte*>(page_it) + sizeof(Page) + (BucketSize * index);
-				Bucket* old_bucket = reinterpret_cast<Bucket*>(bucket);
-				++freed_blocks;
-				index = old_bucket->next_index;
-			}
-
-			// std::cout << "Freed blocks: " << freed_blocks << std::endl;
-			// std::cout << "Allocated blocks: " << BucketsInPage - freed_blocks - (BucketsInPage - page_it->initialized_buckets) << std::endl << std::endl;
-
-			total_free_blocks += freed_blocks;
-			total_uninitialized_blocks += BucketsInPage - page_it->initialized_buckets;
-			page_it = page_it->next_page;
-			++pages_size;
-		}
-
-		std::cout << std::endl << "Total block statistics:" << std::endl;
-		// std::cout << "Total pages: " << pages_size << std::endl;
-		std::cout << "Total blocks: " << BucketsInPage * pages_size << std::endl;
-		std::cout << "Uninitialized blocks: " << total_uninitialized_blocks << std::endl;
-		std::cout << "Freed blocks: " << total_free_blocks << std::endl;
-		std::cout << "Allocated blocks: " << (BucketsInPage * pages_size) - total_free_blocks - total_uninitialized_blocks << std::endl << std::endl;
-
-		// TODO:        :     ,        
-	}
-
-	void dumpBlocks() const
-	{
-		assert(initialized);
-		assert(!deinitialized);
-
-		Page* page_it = first_page;
-		while (page_it) {
-			for (int i = 0; i < page_it->initialized_buckets; ++i) {
-				std::byte* bucket = reinterpret_cast<std::byte*>(page_it) + sizeof(Page) + (BucketSize * i);
-				Bucket* old_bucket = reinterpret_cast<Bucket*>(bucket);
-
-				if (old_bucket->next_index == i) { // it's allocated bucket
-					std::cout << "size - " << old_bucket->size << std::endl;
-					std::cout << "ptr - " << bucket + sizeof(Bucket) << std::endl;
-				}
-			}
-			page_it = page_it->next_page;
-		}
-	}
-#endif
-
-	Page* get_first_page()
-	{
-		return first_page;
-	}
-
-private:
-
-	void* allocate_uninitialized_bucket(Page* page_it, size_t size)
-	{
-		std::byte* bucket_ptr = reinterpret_cast<std::byte*>(page_it) + sizeof(Page) + (BucketSize * page_it->initialized_buckets);
-
-#ifdef _DEBUG
-		// allocated block, let's write own index here
-		Bucket* bucket = new(bucket_ptr)Bucket(page_it->initialized_buckets, size);
-#else
-		Bucket* bucket = new(bucket_ptr)Bucket(page_it->initialized_buckets);
-#endif
-		++page_it->initialized_buckets;
-
-		return bucket_ptr + sizeof(Bucket);
-	}
-
-	void destroy_i(Page* page_it)
-	{
-		if (!page_it) {
-			return;
-		}
-		destroy_i(page_it->next_page);
-		VirtualFree(page_it, 0, MEM_RELEASE);
-	}
-
-	Page* first_page = nullptr;
-
-#ifdef _DEBUG
-	bool initialized = false;
-	bool deinitialized = false;
-#endif
+#pragma once
+
+#include "SlabRegion.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// Buckets have no header: everything about them is kept in the page header,
+// a free bucket stores the free-list link in its first bytes.
+#pragma pack(push, 8)
+struct FixedSizePage {
+	struct FreeBucket {
+		FreeBucket* next_free_bucket;
+	};
+
+	FixedSizePage(void* owner, int bucket_size)
+		: owner(owner), bucket_size(bucket_size)
+	{}
+
+	void* owner; // FixedSizeAllocator the page belongs to
+
+	FixedSizePage* next_page = nullptr;
+	FixedSizePage* prev_page = nullptr;
+	FixedSizePage* next_partial_page = nullptr; // links in the stack of pages which still have free buckets
+	FixedSizePage* prev_partial_page = nullptr;
+	FreeBucket* free_list_begin = nullptr;
+	std::atomic<FreeBucket*> remote_free_list{ nullptr }; // buckets freed without the lock, see FixedSizeAllocator::free_remote
+	std::atomic<int> remote_buckets{ 0 }; // in remote_free_list
+	FixedSizePage* next_remote_page = nullptr; // link in the stack of pages with remote frees
+	int initialized_buckets = 0;
+	// given out and not freed yet, buckets waiting in remote_free_list included;
+	// written by the lock holder only, read by free_remote
+	std::atomic<int> used_buckets{ 0 };
+	int idle_ticks = 0; // purger ticks since the page got empty
+	int bucket_size; // checked against the allocator a block is freed to in debug builds
+};
+#pragma pack(pop)
+
+inline FixedSizePage* fixed_size_page_of(const void* p)
+{
+	// pages are aligned by their size, so the header is found by masking the pointer
+	return reinterpret_cast<FixedSizePage*>(reinterpret_cast<uintptr_t>(p) & ~(PageSize - 1));
+}
+
+// The live map follows the page header: a bit per LiveMapGranularity bytes of the page, set at the buckets
+// MemoryAllocator has given out; the tiers don't look at it, the buckets in thread caches aren't live.
+// Buckets start at its multiples, so the map is the same for every size class and a pointer which isn't
+// the start of a live bucket finds its bit clear.
+constexpr size_t LiveMapGranularity = 8;
+constexpr size_t LiveMapWords = PageSize / LiveMapGranularity / 64;
+
+inline std::atomic<uint64_t>* live_map_of(const FixedSizePage* page)
+{
+	return reinterpret_cast<std::atomic<uint64_t>*>(const_cast<FixedSizePage*>(page) + 1);
+}
+
+inline std::atomic<uint64_t>& live_word_of(const void* p, uint64_t& bit)
+{
+	size_t index = (reinterpret_cast<uintptr_t>(p) & (PageSize - 1)) / LiveMapGranularity;
+	bit = uint64_t(1) << (index % 64);
+	return live_map_of(fixed_size_page_of(p))[index / 64];
+}
+
+// the bucket at p is given out to the user
+inline void mark_live_bucket(void* p)
+{
+	uint64_t bit;
+	live_word_of(p, bit).fetch_or(bit, std::memory_order_relaxed);
+}
+
+// the user gives the bucket at p back, false if p isn't the start of a live bucket;
+// of two concurrent frees of the same bucket only one succeeds
+inline bool unmark_live_bucket(void* p)
+{
+	if (reinterpret_cast<uintptr_t>(p) % LiveMapGranularity) {
+		return false;
+	}
+	uint64_t bit;
+	return live_word_of(p, bit).fetch_and(~bit, std::memory_order_relaxed) & bit;
+}
+
+inline bool is_live_bucket(const void* p)
+{
+	if (reinterpret_cast<uintptr_t>(p) % LiveMapGranularity) {
+		return false;
+	}
+	uint64_t bit;
+	return live_word_of(p, bit).load(std::memory_order_relaxed) & bit;
+}
+
+// empty pages a size class keeps for the next burst before giving them back to the OS
+constexpr int DefaultEmptyPagesLimit = 2;
+
+// aligned to a cache line, so the locks of neighbouring size classes don't share one
+template<int AllocSize>
+class alignas(64) FixedSizeAllocator
+{
+	static_assert(AllocSize >= sizeof(void*) && AllocSize % sizeof(void*) == 0, "free bucket keeps a pointer inside");
+	static_assert(AllocSize <= MaxFixedSize, "pages come from the slice of a size class");
+	static_assert(AllocSize % LiveMapGranularity == 0, "buckets start at the granules of the live map");
+
+private:
+	using Page = FixedSizePage;
+	using Bucket = FixedSizePage::FreeBucket;
+
+public:
+	FixedSizeAllocator() = default;
+	~FixedSizeAllocator()
+	{
+#ifdef _DEBUG
+		assert(initialized);
+		assert(deinitialized);
+#endif
+	}
+
+	// the first page is mapped by the first alloc, so an unused class costs nothing
+	void init()
+	{
+#ifdef _DEBUG
+		assert(!initialized);
+		initialized = true;
+#endif
+	}
+
+	void destroy()
+	{
+#ifdef _DEBUG
+		assert(initialized);
+		assert(!deinitialized);
+		deinitialized = true;
+#endif
+
+		drain_remote_frees();
+
+#ifdef _DEBUG
+		Page* page_it = first_page;
+		while (page_it) {
+			assert(page_it->initialized_buckets == free_list_size(page_it));
+			page_it = page_it->next_page;
+		}
+#endif
+
+		destroy_i(first_page);
+		pages_count.store(0, std::memory_order_relaxed);
+	}
+
+	static constexpr size_t HeaderSize = (sizeof(Page) + LiveMapWords * sizeof(uint64_t) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+	static constexpr size_t BucketSize = AllocSize;
+	static constexpr size_t BucketsInPage = (PageSize - HeaderSize) / BucketSize;
+
+	void* alloc([[maybe_unused]] size_t size)
+	{
+#ifdef _DEBUG
+		assert(initialized);
+		assert(!deinitialized);
+		assert(size <= AllocSize);
+#endif
+		Page* page = partial_pages;
+		if (!page && drain_remote_frees()) {
+			page = partial_pages;
+		}
+		if (!page) {
+			// no free space, let's allocate new page
+			page = map_page();
+			if (!page) {
+				return nullptr;
+			}
+			page->next_page = first_page;
+			if (first_page) {
+				first_page->prev_page = page;
+			}
+			first_page = page;
+			partial_pages = page;
+			++empty_pages;
+			pages_count.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void* result;
+		if (page->free_list_begin) {
+			result = page->free_list_begin;
+			page->free_list_begin = page->free_list_begin->next_free_bucket;
+		}
+		else {
+			result = bucket_at(page, page->initialized_buckets);
+			++page->initialized_buckets;
+		}
+		int used_buckets = page->used_buckets.load(std::memory_order_relaxed);
+		page->used_buckets.store(used_buckets + 1, std::memory_order_relaxed);
+		if (used_buckets == 0) {
+			--empty_pages;
+		}
+
+		if (is_full(page)) {
+			// page is out of the partial stack until something is freed there
+			unlink_partial(page);
+		}
+
+		return result;
+	}
+
+	void free(void* p)
+	{
+		Page* page = fixed_size_page_of(p);
+
+#ifdef _DEBUG
+		assert(initialized);
+		assert(!deinitialized);
+		assert(page->bucket_size == AllocSize);
+		assert((reinterpret_cast<std::byte*>(p) - bucket_at(page, 0)) % BucketSize == 0);
+		assert(!is_free(page, p));
+#endif
+
+		if (is_full(page)) {
+			// page gets a free bucket again
+			push_partial(page);
+		}
+
+		Bucket* bucket = new (p) Bucket{ page->free_list_begin };
+		page->free_list_begin = bucket;
+		int used_buckets = page->used_buckets.load(std::memory_order_relaxed) - 1;
+		page->used_buckets.store(used_buckets, std::memory_order_relaxed);
+		if (used_buckets == 0) {
+			page_emptied(page);
+		}
+	}
+
+	// lock-free free, safe to call concurrently with each other and with the lock holder,
+	// the buckets are reused once they are drained. True when every bucket given out of the page may be
+	// pending now, so draining would empty the page; only a hint, the lock holder may be changing the page meanwhile
+	bool free_remote(void* p)
+	{
+		Page* page = fixed_size_page_of(p);
+
+#ifdef _DEBUG
+		assert(page->bucket_size == AllocSize);
+		assert((reinterpret_cast<std::byte*>(p) - bucket_at(page, 0)) % BucketSize == 0);
+#endif
+
+		// the bucket belongs to the drainer once pushed, so only the local copy of the old head is looked at
+		Bucket* head_bucket = page->remote_free_list.load(std::memory_order_relaxed);
+		Bucket* bucket = new (p) Bucket{ head_bucket };
+		while (!page->remote_free_list.compare_exchange_weak(head_bucket, bucket, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+			bucket->next_free_bucket = head_bucket;
+		}
+
+		if (!head_bucket) {
+			// first pending bucket of the page, the page goes to the drain stack
+			Page* head = remote_pages.load(std::memory_order_relaxed);
+			do {
+				page->next_remote_page = head;
+			} while (!remote_pages.compare_exchange_weak(head, page, std::memory_order_release, std::memory_order_relaxed));
+		}
+
+		int pending = page->remote_buckets.fetch_add(1, std::memory_order_relaxed) + 1;
+		return pending >= page->used_buckets.load(std::memory_order_relaxed);
+	}
+
+	// moves the buckets of free_remote to the free lists of their pages, the lock holder is the only consumer;
+	// alloc drains when it runs out of partial pages, the others when free_remote says a page would get empty
+	bool drain_remote_frees()
+	{
+		Page* page = remote_pages.exchange(nullptr, std::memory_order_acquire);
+		if (!page) {
+			return false;
+		}
+
+		while (page) {
+			// the page may be pushed again as soon as its list is taken
+			Page* next_page = page->next_remote_page;
+			Bucket* bucket = page->remote_free_list.exchange(nullptr, std::memory_order_acq_rel);
+			bool drained = bucket != nullptr;
+			if (bucket && is_full(page)) {
+				push_partial(page);
+			}
+			int drained_buckets = 0;
+			while (bucket) {
+				Bucket* next_bucket = bucket->next_free_bucket;
+				bucket->next_free_bucket = page->free_list_begin;
+				page->free_list_begin = bucket;
+				++drained_buckets;
+				bucket = next_bucket;
+			}
+			page->remote_buckets.fetch_sub(drained_buckets, std::memory_order_relaxed);
+			int used_buckets = page->used_buckets.load(std::memory_order_relaxed) - drained_buckets;
+			page->used_buckets.store(used_buckets, std::memory_order_relaxed);
+			if (drained && !used_buckets) {
+				page_emptied(page);
+			}
+			page = next_page;
+		}
+		return true;
+	}
+
+	// may be read while other threads allocate
+	int get_pages_count() const
+	{
+		return pages_count.load(std::memory_order_relaxed);
+	}
+
+	// pages given back to the OS since init
+	size_t get_released_pages_count() const
+	{
+		return released_pages.load(std::memory_order_relaxed);
+	}
+
+	// empty pages above the limit are released as soon as they get empty,
+	// a few kept ones save mapping them again on bursty load; lowering the limit releases the extra ones
+	void set_empty_pages_limit(int limit)
+	{
+		empty_pages_limit = limit;
+		// pages freed by other threads may be empty already
+		drain_remote_frees();
+		Page* page = partial_pages;
+		while (page && empty_pages > empty_pages_limit) {
+			Page* next_page = page->next_partial_page;
+			if (!page->used_buckets.load(std::memory_order_relaxed)) {
+				--empty_pages;
+				release_page(page);
+			}
+			page = next_page;
+		}
+	}
+
+	// a tick of the background purger: empty pages get older, then the oldest ones are released
+	// until the rest fits decay_curve of their age in decay ticks, returns the bytes released
+	size_t decay(int decay_ticks, double (*decay_curve)(double))
+	{
+		// pages freed by other threads may be empty already
+		drain_remote_frees();
+
+		std::vector<Page*> idle_pages;
+		double kept_pages = 0;
+		for (Page* page = partial_pages; page; page = page->next_partial_page) {
+			if (!page->used_buckets.load(std::memory_order_relaxed)) {
+				++page->idle_ticks;
+				kept_pages += decay_curve(static_cast<double>(page->idle_ticks) / decay_ticks);
+				idle_pages.push_back(page);
+			}
+		}
+
+		std::stable_sort(idle_pages.begin(), idle_pages.end(), [](const Page* a, const Page* b) {
+			return a->idle_ticks > b->idle_ticks;
+		});
+		size_t released_count = idle_pages.size() - std::min(idle_pages.size(), static_cast<size_t>(std::ceil(kept_pages)));
+		for (size_t i = 0; i < released_count; ++i) {
+			--empty_pages;
+			release_page(idle_pages[i]);
+		}
+		return released_count * PageSize;
+	}
+
+#ifdef _DEBUG
+	int get_allocated_blocks() const
+	{
+		int pages_size = 0;
+		int total_free_blocks = 0;
+		int total_uninitialized_blocks = 0;
+
+		Page* page_it = first_page;
+		while (page_it) {
+			total_free_blocks += free_list_size(page_it);
+			total_uninitialized_blocks += BucketsInPage - page_it->initialized_buckets;
+			page_it = page_it->next_page;
+			++pages_size;
+		}
+
+		return (BucketsInPage * pages_size) - total_free_blocks - total_uninitialized_blocks;
+	}
+
+	int get_freed_blocks() const
+	{
+		int total_free_blocks = 0;
+
+		Page* page_it = first_page;
+		while (page_it) {
+			total_free_blocks += free_list_size(page_it);
+			page_it = page_it->next_page;
+		}
+
+		return total_free_blocks;
+	}
+
+	int get_uninitialized_blocks() const
+	{
+		int total_uninitialized_blocks = 0;
+
+		Page* page_it = first_page;
+		while (page_it) {
+			total_uninitialized_blocks += BucketsInPage - page_it->initialized_buckets;
+			page_it = page_it->next_page;
+		}
+
+		return total_uninitialized_blocks;
+	}
+
+	void dumpStat() const
+	{
+		assert(initialized);
+		assert(!deinitialized);
+
+		int pages_size = 0;
+		int total_blocks = 0;
+		int total_free_blocks = 0;
+		int total_uninitialized_blocks = 0;
+
+		std::cout << "Blocks: " << AllocSize << std::endl;
+		Page* page_it = first_page;
+		while (page_it) {
+			//std::cout << "Page, size " << PageSize << ", block statistics:" << std::endl;
+			// std::cout << "Total blocks: " << BucketsInPage << std::endl;
+			// std::cout << "Uninitialized blocks: " << BucketsInPage - page_it->initialized_buckets << std::endl;
+
+			int freed_blocks = free_list_size(page_it);
+
+			// std::cout << "Freed blocks: " << freed_blocks << std::endl;
+			// std::cout << "Allocated blocks: " << BucketsInPage - freed_blocks - (BucketsInPage - page_it->initialized_buckets) << std::endl << std::endl;
+
+			total_free_blocks += freed_blocks;
+			total_uninitialized_blocks += BucketsInPage - page_it->initialized_buckets;
+			page_it = page_it->next_page;
+			++pages_size;
+		}
+
+		std::cout << std::endl << "Total block statistics:" << std::endl;
+		// std::cout << "Total pages: " << pages_size << std::endl;
+		std::cout << "Total blocks: " << BucketsInPage * pages_size << std::endl;
+		std::cout << "Uninitialized blocks: " << total_uninitialized_blocks << std::endl;
+		std::cout << "Freed blocks: " << total_free_blocks << std::endl;
+		std::cout << "Allocated blocks: " << (BucketsInPage * pages_size) - total_free_blocks - total_uninitialized_blocks << std::endl << std::endl;
+
+		// TODO: Выводит в стандартный поток вывода статистику по аллокатору: количество занятых и свободных блоков, список блоков запрошенных у ОС и их размеры
+	}
+
+	void dumpBlocks() const
+	{
+		assert(initialized);
+		assert(!deinitialized);
+
+		Page* page_it = first_page;
+		while (page_it) {
+			// buckets don't know their state, so mark the free ones first
+			std::vector<bool> freed(page_it->initialized_buckets, false);
+			for (Bucket* it = page_it->free_list_begin; it; it = it->next_free_bucket) {
+				freed[(reinterpret_cast<std::byte*>(it) - bucket_at(page_it, 0)) / BucketSize] = true;
+			}
+
+			for (int i = 0; i < page_it->initialized_buckets; ++i) {
+				if (!freed[i]) { // it's allocated bucket
+					std::cout << "size - " << AllocSize << std::endl;
+					std::cout << "ptr - " << bucket_at(page_it, i) << std::endl;
+				}
+			}
+			page_it = page_it->next_page;
+		}
+	}
+#endif
+
+	Page* get_first_page()
+	{
+		return first_page;
+	}
+
+	// the allocator itself isn't synchronized, concurrent users share this lock
+	std::mutex& get_lock()
+	{
+		return tier_lock;
+	}
+
+private:
+
+	Page* map_page()
+	{
+		void* new_page_ptr = SlabRegion::instance().acquire_page(size_class_of(AllocSize));
+		if (!new_page_ptr) {
+			return nullptr;
+		}
+		Page* page = new (new_page_ptr) Page(this, AllocSize);
+		// a purged page isn't zeroed on every OS
+		for (size_t i = 0; i < LiveMapWords; ++i) {
+			live_map_of(page)[i].store(0, std::memory_order_relaxed);
+		}
+		return page;
+	}
+
+	static std::byte* bucket_at(const Page* page, int index)
+	{
+		return reinterpret_cast<std::byte*>(const_cast<Page*>(page)) + HeaderSize + (BucketSize * index);
+	}
+
+	static bool is_full(const Page* page)
+	{
+		return page->initialized_buckets == BucketsInPage && !page->free_list_begin;
+	}
+
+	void push_partial(Page* page)
+	{
+		page->prev_partial_page = nullptr;
+		page->next_partial_page = partial_pages;
+		if (partial_pages) {
+			partial_pages->prev_partial_page = page;
+		}
+		partial_pages = page;
+	}
+
+	void unlink_partial(Page* page)
+	{
+		if (page->prev_partial_page) {
+			page->prev_partial_page->next_partial_page = page->next_partial_page;
+		}
+		else {
+			partial_pages = page->next_partial_page;
+		}
+		if (page->next_partial_page) {
+			page->next_partial_page->prev_partial_page = page->prev_partial_page;
+		}
+		page->next_partial_page = nullptr;
+		page->prev_partial_page = nullptr;
+	}
+
+	// an empty page has all its buckets free, so it's in the partial stack and nothing points into it
+	void page_emptied(Page* page)
+	{
+		if (empty_pages < empty_pages_limit) {
+			++empty_pages;
+			page->idle_ticks = 0;
+			return;
+		}
+		release_page(page);
+	}
+
+	void release_page(Page* page)
+	{
+		unlink_partial(page);
+		if (page->prev_page) {
+			page->prev_page->next_page = page->next_page;
+		}
+		else {
+			first_page = page->next_page;
+		}
+		if (page->next_page) {
+			page->next_page->prev_page = page->prev_page;
+		}
+		SlabRegion::instance().release_page(page);
+		pages_count.fetch_sub(1, std::memory_order_relaxed);
+		released_pages.fetch_add(1, std::memory_order_relaxed);
+	}
+
+#ifdef _DEBUG
+	static int free_list_size(const Page* page)
+	{
+		int freed_blocks = 0;
+		for (Bucket* it = page->free_list_begin; it; it = it->next_free_bucket) {
+			++freed_blocks;
+		}
+		return freed_blocks;
+	}
+
+	static bool is_free(const Page* page, const void* p)
+	{
+		for (Bucket* it = page->free_list_begin; it; it = it->next_free_bucket) {
+			if (it == p) {
+				return true;
+			}
+		}
+		return false;
+	}
+#endif
+
+	void destroy_i(Page* page_it)
+	{
+		if (!page_it) {
+			return;
+		}
+		destroy_i(page_it->next_page);
+		SlabRegion::instance().release_page(page_it);
+	}
+
+	Page* first_page = nullptr;
+	Page* partial_pages = nullptr;
+	std::atomic<Page*> remote_pages{ nullptr }; // pages with remote frees, pushed by free_remote
+	std::atomic<int> pages_count{ 0 };
+	std::atomic<size_t> released_pages{ 0 };
+	int empty_pages = 0; // in the partial stack with no bucket given out
+	int empty_pages_limit = DefaultEmptyPagesLimit;
+
+	std::mutex tier_lock;
+
+#ifdef _DEBUG
+	bool initialized = false;
+	bool deinitialized = false;
+#endif
 };
\ No newline at end of file
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "PageProvider.h"
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+
+// retired huge mappings kept for reuse, in bytes
+constexpr size_t DefaultHugeCacheBytes = 1024*1024*128;
+constexpr std::chrono::milliseconds DefaultHugeCacheAge{ 1000 };
+
+// Huge mappings retired by free and kept for the next huge blocks, so repeated big scratch buffers
+// skip mmap/munmap and faulting in fresh zeroed pages. A mapping is taken by best fit among
+// the ones at most twice as big as needed. The cache holds no more than its byte budget, the oldest
+// mappings go first, and the ones unused for the max age are unmapped on the next put or by the purger.
+class HugeCache
+{
+public:
+	using Clock = std::chrono::steady_clock;
+	static constexpr int Capacity = 16;
+
+	struct Stats {
+		int mappings;
+		size_t bytes;
+		size_t hits;
+		size_t misses;
+	};
+
+	HugeCache() = default;
+	~HugeCache()
+	{
+		release();
+	}
+
+	HugeCache(const HugeCache&) = delete;
+	HugeCache& operator=(const HugeCache&) = delete;
+
+	// zero budget turns the cache off
+	void set_limits(size_t budget, std::chrono::milliseconds max_age)
+	{
+		this->budget = budget;
+		this->max_age = max_age;
+		evict_expired();
+	}
+
+	// a cached mapping of size bytes or a bit more, its whole size is stored to mapping_size,
+	// nullptr if none fits
+	void* take(size_t size, size_t& mapping_size)
+	{
+		int best = -1;
+		for (int i = 0; i < count; ++i) {
+			if (entries[i].size >= size && entries[i].size / 2 <= size
+				&& (best < 0 || entries[i].size < entries[best].size)) {
+				best = i;
+			}
+		}
+		if (best < 0) {
+			++misses;
+			return nullptr;
+		}
+
+		++hits;
+		void* mapping = entries[best].mapping;
+		mapping_size = entries[best].size;
+		remove(best);
+		return mapping;
+	}
+
+	// keeps the mapping for reuse or unmaps it
+	void put(void* mapping, size_t size)
+	{
+		Clock::time_point now = Clock::now();
+		evict_older_than(now - max_age);
+		if (size > budget) {
+			PageProvider::unmap(mapping, size);
+			return;
+		}
+		while (count == Capacity || bytes + size > budget) {
+			evict(oldest());
+		}
+		entries[count++] = Entry{ mapping, size, now };
+		bytes += size;
+	}
+
+	// unmaps the mappings unused for the max age, returns the bytes given back
+	size_t evict_expired()
+	{
+		return evict_older_than(Clock::now() - max_age);
+	}
+
+	void release()
+	{
+		while (count) {
+			evict(count - 1);
+		}
+	}
+
+	Stats get_stats() const
+	{
+		return Stats{ count, bytes, hits, misses };
+	}
+
+	std::mutex& get_lock()
+	{
+		return lock;
+	}
+
+private:
+	struct Entry {
+		void* mapping;
+		size_t size;
+		Clock::time_point retired;
+	};
+
+	size_t evict_older_than(Clock::time_point time)
+	{
+		size_t evicted_bytes = 0;
+		for (int i = count - 1; i >= 0; --i) {
+			if (entries[i].retired < time) {
+				evicted_bytes += entries[i].size;
+				evict(i);
+			}
+		}
+		return evicted_bytes;
+	}
+
+	int oldest() const
+	{
+		int oldest = 0;
+		for (int i = 1; i < count; ++i) {
+			if (entries[i].retired < entries[oldest].retired) {
+				oldest = i;
+			}
+		}
+		return oldest;
+	}
+
+	void evict(int index)
+	{
+		PageProvider::unmap(entries[index].mapping, entries[index].size);
+		remove(index);
+	}
+
+	void remove(int index)
+	{
+		bytes -= entries[index].size;
+		entries[index] = entries[--count];
+	}
+
+	Entry entries[Capacity];
+	int count = 0;
+	size_t bytes = 0;
+	size_t budget = DefaultHugeCacheBytes;
+	std::chrono::milliseconds max_age = DefaultHugeCacheAge;
+
+	size_t hits = 0;
+	size_t misses = 0;
+
+	std::mutex lock;
+};
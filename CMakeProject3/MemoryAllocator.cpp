@@ -1,153 +1,657 @@
-#include "MemoryAllocator.h"
-
-void MemoryAllocator::init()
-{
-	m_fixed_size16.init();
-	m_fixed_size32.init();
-	m_fixed_size64.init();
-	m_fixed_size128.init();
-	m_fixed_size256.init();
-	m_fixed_size512.init();
-	m_coalesed.init();
-}
-
-void MemoryAllocator::destroy()
-{
-	m_fixed_size16.destroy();
-	m_fixed_size32.destroy();
-	m_fixed_size64.destroy();
-	m_fixed_size128.destroy();
-	m_fixed_size256.destroy();
-	m_fixed_size512.destroy();
-	m_coalesed.destroy();
-}
-
-#pragma pack(push, 8)
-struct Bucket
-{
-	int allocator_type; // for detecting allocator
-};
-#pragma pack(pop)
-
-void* MemoryAllocator::alloc(size_t size)
-{
-	if (size <= 16) {
-		void * ptr = m_fixed_size16.alloc(size);
-		*reinterpret_cast<int*>(reinterpret_cast<std::byte*>(ptr) - sizeof(int)) = 1;
-		return ptr;
-	}
-	else if (size <= 32) {
-		void* ptr = m_fixed_size32.alloc(size);
-		*reinterpret_cast<int*>(reinterpret_cast<std::byte*>(ptr) - sizeof(int)) = 2;
-		return ptr;
-	}
-	else if (size <= 64) {
-		void* ptr = m_fixed_size64.alloc(size);
-		*reinterpret_cast<int*>(reinterpret_cast<std::byte*>(ptr) - sizeof(int)) = 3;
-		return ptr;
-	}
-	else if (size <= 128) {
-		void* ptr = m_fixed_size128.alloc(size);
-		*reinterpret_cast<int*>(reinterpret_cast<std::byte*>(ptr) - sizeof(int)) = 4;
-		return ptr;
-	}
-	else if (size <= 256) {
-		void* ptr = m_fixed_size256.alloc(size);
-		*reinterpret_cast<int*>(reinterpret_cast<std::byte*>(ptr) - sizeof(int)) = 5;
-		return ptr;
-	}
-	else if (size <= 512) {
-		void* ptr = m_fixed_size512.alloc(size);
-		*reinterpret_cast<int*>(reinterpret_cast<std::byte*>(ptr) - sizeof(int)) = 6;
-		return ptr;
-	}
-	else if (size <= 1024*1024*10) {
-		void* ptr = m_coalesed.alloc(size);
-		*reinterpret_cast<int*>(reinterpret_cast<std::byte*>(ptr) - sizeof(int)) = 7;
-		return ptr;
-	}
-	LPVOID ptr = VirtualAlloc(NULL, size + sizeof(Bucket), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-	*reinterpret_cast<int*>(reinterpret_cast<std::byte*>(ptr) + sizeof(Bucket) - sizeof(int)) = 8;
-	return reinterpret_cast<std::byte*>(ptr) + sizeof(Bucket);
-}
-
-void MemoryAllocator::free(void* p)
-{
-	int allocator_type = *reinterpret_cast<int*>(reinterpret_cast<std::byte*>(p) - sizeof(int));
-	switch (allocator_type)
-	{
-	case 1: {
-		m_fixed_size16.free(p);
-		break;
-	}
-	case 2: {
-		m_fixed_size32.free(p);
-		break;
-	}
-	case 3: {
-		m_fixed_size64.free(p);
-		break;
-	}
-	case 4: {
-		m_fixed_size128.free(p);
-		break;
-	}
-	case 5: {
-		m_fixed_size256.free(p);
-		break;
-	}
-	case 6: {
-		m_fixed_size512.free(p);
-		break;
-	}
-	case 7: {
-		m_coalesed.free(p);
-		break;
-	}
-	case 8: {
-		VirtualFree(reinterpret_cast<std::byte*>(p) - sizeof(Bucket), 0, MEM_RELEASE);
-		break;
-	}
-	default:
-		break;
-	}
-}
-
-#ifdef _DEBUG
-
-void MemoryAllocator::dumpStat() const
-{
-	std::cout << std::endl << "Total block statistics:" << std::endl;
-	std::cout << "Pages: " << std::endl;
-	std::cout << "size " << CoalesedPageSize << ": " << m_coalesed.get_pages_count() << std::endl;
-	std::cout << "size " << PageSize << ": ";
-	int pages_count = 0;
-	pages_count += m_fixed_size16.get_pages_count();
-	pages_count += m_fixed_size32.get_pages_count();
-	pages_count += m_fixed_size64.get_pages_count();
-	pages_count += m_fixed_size128.get_pages_count();
-	pages_count += m_fixed_size256.get_pages_count();
-	pages_count += m_fixed_size512.get_pages_count();
-	std::cout << pages_count << std::endl;
-
-	m_fixed_size16.dumpStat();
-	m_fixed_size32.dumpStat();
-	m_fixed_size64.dumpStat();
-	m_fixed_size128.dumpStat();
-	m_fixed_size256.dumpStat();
-	m_fixed_size512.dumpStat();
-	m_coalesed.dumpStat();
-}
-
-void MemoryAllocator::dumpBlocks() const
-{
-	m_fixed_size16.dumpBlocks();
-	m_fixed_size32.dumpBlocks();
-	m_fixed_size64.dumpBlocks();
-	m_fixed_size128.dumpBlocks();
-	m_fixed_size256.dumpBlocks();
-	m_fixed_size512.dumpBlocks();
-	m_coalesed.dumpBlocks();
-}
-
+#include "MemoryAllocator.h"
+#include "PageMap.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+void MemoryAllocator::init()
+{
+	m_huge_cache.set_limits(m_options.huge_cache_bytes, m_options.huge_cache_age);
+
+	// thread arenas are created by the threads which need them
+	int arenas_count = m_options.thread_arenas ? 0 : std::max(m_options.arenas, 1);
+	for (int i = 0; i < arenas_count; ++i) {
+		create_arena(0);
+	}
+}
+
+void MemoryAllocator::destroy()
+{
+	m_purger.stop();
+	ThreadCache::detach_all(*this);
+
+	Arena* arena_it = m_arenas.exchange(nullptr);
+	while (arena_it) {
+		Arena* next_arena = arena_it->next_arena;
+		arena_it->destroy();
+		delete arena_it;
+		arena_it = next_arena;
+	}
+	m_arenas_count.store(0, std::memory_order_relaxed);
+
+	m_huge_cache.release();
+}
+
+#pragma pack(push, 8)
+struct Bucket
+{
+	size_t size; // whole mapping size, needed to unmap it
+	size_t reserved; // keeps the payload 16 byte aligned
+};
+#pragma pack(pop)
+
+// bigger blocks are mapped one by one
+constexpr size_t MaxCoalesedSize = 1024*1024*10;
+// the biggest huge block whose mapping fits size_t with the header, the rounding to huge pages
+// and the slack of an aligned mapping
+constexpr size_t MaxHugeSize = SIZE_MAX - sizeof(Bucket) - 2 * HugePageSize;
+
+// registers a huge mapping, its metadata is its header; false if the page map can't take it
+static bool register_huge(Bucket* bucket)
+{
+	if (PageMap::instance().set(bucket, bucket->size, PageMap::Kind::Huge, bucket)) {
+		return true;
+	}
+	PageMap::instance().clear(bucket, bucket->size);
+	return false;
+}
+
+// whether p is a block given out rather than a pointer into one, a freed block or a page not in use;
+// entry is the page map entry of p, a fixed-size page is known to be in use before its live map is read
+static bool is_live(const void* p, const PageMap::Entry& entry)
+{
+	switch (entry.kind)
+	{
+	case PageMap::Kind::FixedSize:
+		return is_live_bucket(p);
+	case PageMap::Kind::Coalesed:
+		return CoalesedAllocator::is_live(p);
+	case PageMap::Kind::Huge:
+		return p == static_cast<std::byte*>(entry.metadata) + sizeof(Bucket);
+	default:
+		return false;
+	}
+}
+
+void* MemoryAllocator::alloc(size_t size)
+{
+	// fixed-size blocks have no header, they are recognised by SlabRegion on free
+	if (size <= MaxFixedSize) {
+		int size_class = size_class_of(size);
+		void* ptr;
+		if (m_options.thread_cache) {
+			ptr = alloc_cached(size_class);
+		}
+		else {
+			const SizeClassDescriptor& descriptor = SizeClassDescriptors[size_class];
+			void* tier = arena().fixed_size_tiers[size_class];
+			auto guard = lock_fixed_size(descriptor.get_lock(tier));
+			ptr = descriptor.alloc(tier);
+		}
+		// only the blocks given out are live, not the ones waiting in the thread caches
+		if (ptr) {
+			mark_live_bucket(ptr);
+		}
+		return ptr;
+	}
+	else if (size <= MaxCoalesedSize) {
+		CoalesedAllocator& coalesed = arena().coalesed;
+		auto guard = lock(coalesed.get_lock());
+		return coalesed.alloc(size);
+	}
+	else if (size > MaxHugeSize) {
+		return nullptr;
+	}
+
+	size_t mapping_size = huge_mapping_size(size);
+	void* ptr;
+	{
+		auto guard = lock(m_huge_cache.get_lock());
+		ptr = m_huge_cache.take(mapping_size, mapping_size);
+	}
+	if (!ptr) {
+		ptr = map_huge(mapping_size);
+		if (!ptr) {
+			return nullptr;
+		}
+	}
+	Bucket* bucket = reinterpret_cast<Bucket*>(ptr);
+	bucket->size = mapping_size;
+	if (!register_huge(bucket)) {
+		PageProvider::unmap(bucket, mapping_size);
+		return nullptr;
+	}
+	return reinterpret_cast<std::byte*>(ptr) + sizeof(Bucket);
+}
+
+void MemoryAllocator::free(void* p)
+{
+	// pointers nobody has given out, pointers into blocks and blocks freed already are ignored
+	SlabRegion& slab_region = SlabRegion::instance();
+	if (slab_region.contains(p)) {
+		// the size class comes from the address, the page map tells a page in use before its live map is read,
+		// a cached free reads no memory of the block
+		int size_class = slab_region.size_class_of(p);
+		if (PageMap::instance().lookup(p).kind != PageMap::Kind::FixedSize || !unmark_live_bucket(p)) {
+			return;
+		}
+		if (m_options.thread_cache) {
+			free_cached(size_class, p);
+			return;
+		}
+
+		// the owner of a thread arena frees its blocks directly, everybody else through the remote lists
+		FixedSizePage* page = fixed_size_page_of(p);
+		if (!m_options.concurrent || (m_options.thread_arenas && arena().owns(page))) {
+			SizeClassDescriptors[size_class].free(page->owner, p);
+			return;
+		}
+		free_remote(p);
+		return;
+	}
+
+	// the other tiers are told by the page map
+	PageMap::Entry entry = PageMap::instance().lookup(p);
+	switch (entry.kind)
+	{
+	case PageMap::Kind::Coalesed: {
+		// the block goes back to the arena it came from, which checks it under its lock
+		CoalesedAllocator* coalesed = CoalesedAllocator::owner_of(p);
+		auto guard = lock(coalesed->get_lock());
+		coalesed->free(p);
+		break;
+	}
+	case PageMap::Kind::Huge: {
+		if (!is_live(p, entry)) {
+			break;
+		}
+		// a retired mapping isn't live any more, the cache may unmap it and the range may be taken by anybody
+		Bucket* bucket = static_cast<Bucket*>(entry.metadata);
+		PageMap::instance().clear(bucket, bucket->size);
+		auto guard = lock(m_huge_cache.get_lock());
+		m_huge_cache.put(bucket, bucket->size);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+size_t MemoryAllocator::usable_size(const void* p) const
+{
+	PageMap::Entry entry = PageMap::instance().lookup(p);
+	if (!is_live(p, entry)) {
+		return 0;
+	}
+	switch (entry.kind)
+	{
+	case PageMap::Kind::FixedSize:
+		return SizeClasses[SlabRegion::instance().size_class_of(p)];
+	case PageMap::Kind::Coalesed:
+		return CoalesedAllocator::block_size(p);
+	default:
+		return static_cast<Bucket*>(entry.metadata)->size - sizeof(Bucket);
+	}
+}
+
+void* MemoryAllocator::realloc(void* p, size_t size)
+{
+	if (!p) {
+		return alloc(size);
+	}
+	if (!size) {
+		free(p);
+		return nullptr;
+	}
+	if (size > MaxHugeSize) {
+		// no block can be that big, the old one stays
+		return nullptr;
+	}
+
+	PageMap::Entry entry = PageMap::instance().lookup(p);
+	if (!is_live(p, entry)) {
+		// nobody has given the pointer out, there is no block to resize
+#ifdef _DEBUG
+		assert(!"realloc of a pointer the allocator doesn't own");
+#endif
+		return nullptr;
+	}
+
+	size_t old_size;
+	SlabRegion& slab_region = SlabRegion::instance();
+	if (slab_region.contains(p)) {
+		// a fixed-size block only moves when the size class changes
+		int size_class = slab_region.size_class_of(p);
+		if (size <= MaxFixedSize && size_class_of(size) == size_class) {
+			return p;
+		}
+		old_size = SizeClasses[size_class];
+	}
+	else if (entry.kind == PageMap::Kind::Coalesed) {
+		// blocks which fit a fixed-size class are moved there
+		if (size > MaxFixedSize && size <= MaxCoalesedSize) {
+			CoalesedAllocator* coalesed = CoalesedAllocator::owner_of(p);
+			auto guard = lock(coalesed->get_lock());
+			if (coalesed->resize(p, size)) {
+				return p;
+			}
+		}
+		old_size = CoalesedAllocator::block_size(p);
+	}
+	else {
+		Bucket* bucket = static_cast<Bucket*>(entry.metadata);
+		old_size = bucket->size - sizeof(Bucket);
+		if (size > MaxCoalesedSize) {
+			// a huge block is resized by the OS without copying where it can be
+			void* new_p = remap_huge(bucket, size);
+			if (new_p) {
+				return new_p;
+			}
+			if (size <= old_size && size > old_size / 2) {
+				return p;
+			}
+		}
+	}
+
+	void* new_p = alloc(size);
+	if (!new_p) {
+		return nullptr;
+	}
+	memcpy(new_p, p, std::min(old_size, size));
+	free(p);
+	return new_p;
+}
+
+void MemoryAllocator::flush_thread_cache()
+{
+	if (m_options.thread_cache) {
+		flush_thread_cache(ThreadCache::of(*this));
+	}
+}
+
+int MemoryAllocator::get_arenas_count() const
+{
+	return m_arenas_count.load(std::memory_order_acquire);
+}
+
+int MemoryAllocator::get_arena()
+{
+	return arena().index;
+}
+
+bool MemoryAllocator::select_arena(int index)
+{
+	Arena* target = arena_at(index);
+	if (!target) {
+		return false;
+	}
+	if (m_options.arenas <= 1 && !m_options.thread_arenas) {
+		// the only arena
+		return true;
+	}
+
+	ThreadCache& cache = ThreadCache::of(*this);
+	if (cache.arena == target) {
+		return true;
+	}
+	if (m_options.thread_arenas) {
+		int threads_count = 0;
+		if (!target->threads_count.compare_exchange_strong(threads_count, 1, std::memory_order_acquire)) {
+			return false;
+		}
+	}
+	else {
+		target->threads_count.fetch_add(1, std::memory_order_relaxed);
+	}
+	cache.arena->threads_count.fetch_sub(1, std::memory_order_release);
+	cache.arena = target;
+	return true;
+}
+
+MemoryAllocator::ArenaStats MemoryAllocator::get_arena_stats(int index) const
+{
+	ArenaStats stats{};
+	Arena* arena = arena_at(index);
+	if (arena) {
+		stats.threads_count = arena->threads_count.load(std::memory_order_relaxed);
+		stats.fixed_size_pages = arena->get_fixed_size_pages_count();
+		stats.coalesed_pages = arena->coalesed.get_pages_count();
+		stats.released_fixed_size_pages = arena->get_fixed_size_released_pages_count();
+		stats.purged_coalesed_bytes = arena->coalesed.get_purged_bytes();
+		stats.committed_coalesed_bytes = arena->coalesed.get_committed_bytes();
+	}
+	return stats;
+}
+
+bool MemoryAllocator::start_purger(const Purger::Options& options)
+{
+	if (!m_options.concurrent) {
+		return false;
+	}
+
+	// arenas created meanwhile are deferred by create_arena
+	std::lock_guard<std::mutex> guard(m_arenas_lock);
+	for (Arena* arena_it = m_arenas.load(std::memory_order_relaxed); arena_it; arena_it = arena_it->next_arena) {
+		defer_purging(*arena_it, true);
+	}
+	m_purger.start(options);
+	return true;
+}
+
+void MemoryAllocator::stop_purger()
+{
+	std::lock_guard<std::mutex> guard(m_arenas_lock);
+	if (!m_purger.is_running()) {
+		return;
+	}
+	m_purger.stop();
+	// what was kept for the purger is trimmed to what the tiers keep on their own
+	for (Arena* arena_it = m_arenas.load(std::memory_order_relaxed); arena_it; arena_it = arena_it->next_arena) {
+		defer_purging(*arena_it, false);
+		size_t purged_bytes = 0;
+		bool more = true;
+		while (more) {
+			std::lock_guard<std::mutex> guard(arena_it->coalesed.get_lock());
+			more = arena_it->coalesed.trim(purged_bytes);
+		}
+	}
+}
+
+Purger::Stats MemoryAllocator::get_purger_stats() const
+{
+	return m_purger.get_stats();
+}
+
+HugeCache::Stats MemoryAllocator::get_huge_cache_stats()
+{
+	auto guard = lock(m_huge_cache.get_lock());
+	return m_huge_cache.get_stats();
+}
+
+// while the purger runs, the tiers keep their free memory and leave the syscalls to it
+void MemoryAllocator::defer_purging(Arena& arena, bool deferred)
+{
+	// fixed-size tiers of thread arenas are used without locks, they go on releasing pages on their own
+	if (!m_options.thread_arenas) {
+		arena.for_each_fixed_size([&](auto& allocator) {
+			std::lock_guard<std::mutex> guard(allocator.get_lock());
+			allocator.set_empty_pages_limit(deferred ? INT_MAX : m_options.empty_pages_limit);
+		});
+	}
+	std::lock_guard<std::mutex> guard(arena.coalesed.get_lock());
+	arena.coalesed.set_purge_threshold(deferred ? SIZE_MAX : DefaultPurgeThreshold);
+}
+
+size_t MemoryAllocator::purge_decayed(int decay_ticks, double (*decay_curve)(double))
+{
+	size_t purged_bytes = 0;
+	for (Arena* arena_it = m_arenas.load(std::memory_order_acquire); arena_it; arena_it = arena_it->next_arena) {
+		if (!m_options.thread_arenas) {
+			arena_it->for_each_fixed_size([&](auto& allocator) {
+				std::lock_guard<std::mutex> guard(allocator.get_lock());
+				purged_bytes += allocator.decay(decay_ticks, decay_curve);
+			});
+		}
+		// the heap is walked in batches, the arena allocates and frees between them
+		bool more = true;
+		while (more) {
+			std::lock_guard<std::mutex> guard(arena_it->coalesed.get_lock());
+			more = arena_it->coalesed.decay(decay_ticks, decay_curve, purged_bytes);
+		}
+	}
+
+	std::lock_guard<std::mutex> guard(m_huge_cache.get_lock());
+	purged_bytes += m_huge_cache.evict_expired();
+	return purged_bytes;
+}
+
+Arena& MemoryAllocator::arena()
+{
+	// the only arena is shared without looking at the thread
+	if (m_options.arenas <= 1 && !m_options.thread_arenas) {
+		return *m_arenas.load(std::memory_order_relaxed);
+	}
+	return *ThreadCache::of(*this).arena;
+}
+
+Arena* MemoryAllocator::arena_at(int index) const
+{
+	for (Arena* arena_it = m_arenas.load(std::memory_order_acquire); arena_it; arena_it = arena_it->next_arena) {
+		if (arena_it->index == index) {
+			return arena_it;
+		}
+	}
+	return nullptr;
+}
+
+void* MemoryAllocator::map_huge(size_t mapping_size)
+{
+	if (!m_options.huge_pages) {
+		return PageProvider::map(mapping_size);
+	}
+	void* ptr = PageProvider::map_aligned(mapping_size, HugePageSize);
+	if (ptr) {
+		PageProvider::advise_huge_pages(ptr, mapping_size);
+	}
+	return ptr;
+}
+
+// resizes a huge block by the OS, nullptr if it can't; the block stays registered and valid then.
+// A shrunk block stays where it is, a grown one is moved onto a range registered before the move,
+// so the page map never has to take a block which is already moved.
+void* MemoryAllocator::remap_huge(void* block, size_t size)
+{
+	Bucket* bucket = static_cast<Bucket*>(block);
+	size_t mapping_size = huge_mapping_size(size);
+	PageMap& page_map = PageMap::instance();
+	if (mapping_size <= bucket->size) {
+		// the end may be taken by anybody as soon as it's given back, the entries of the rest are kept
+		size_t granularity = PageProvider::granularity();
+		uintptr_t end = (reinterpret_cast<uintptr_t>(bucket) + mapping_size + granularity - 1) & ~(granularity - 1);
+		uintptr_t old_end = reinterpret_cast<uintptr_t>(bucket) + bucket->size;
+		if (end < old_end) {
+			page_map.clear(reinterpret_cast<void*>(end), old_end - end);
+		}
+		if (!PageProvider::shrink(bucket, bucket->size, mapping_size)) {
+			// the leaves of a range registered once stay, registering it again can't fail
+			register_huge(bucket);
+			return nullptr;
+		}
+		bucket->size = mapping_size;
+		return reinterpret_cast<std::byte*>(bucket) + sizeof(Bucket);
+	}
+
+	void* target = m_options.huge_pages ? PageProvider::reserve_aligned(mapping_size, HugePageSize) : PageProvider::reserve(mapping_size);
+	if (!target) {
+		return nullptr;
+	}
+	if (!page_map.set(target, mapping_size, PageMap::Kind::Huge, target)) {
+		page_map.clear(target, mapping_size);
+		PageProvider::unmap(target, mapping_size);
+		return nullptr;
+	}
+	// the old range may be taken by anybody as soon as it's moved
+	page_map.clear(bucket, bucket->size);
+	if (!PageProvider::remap(bucket, bucket->size, target, mapping_size)) {
+		// can't fail either
+		register_huge(bucket);
+		// the target is given up, its range may be registered by somebody else by now
+		page_map.clear(target, mapping_size, PageMap::Kind::Huge, target);
+		return nullptr;
+	}
+	bucket = static_cast<Bucket*>(target);
+	bucket->size = mapping_size;
+	return reinterpret_cast<std::byte*>(bucket) + sizeof(Bucket);
+}
+
+// a huge block with its header, in whole huge pages when they are asked for
+size_t MemoryAllocator::huge_mapping_size(size_t size) const
+{
+	size_t mapping_size = size + sizeof(Bucket);
+	if (m_options.huge_pages) {
+		mapping_size = (mapping_size + HugePageSize - 1) & ~(HugePageSize - 1);
+	}
+	return mapping_size;
+}
+
+Arena* MemoryAllocator::create_arena(int threads_count)
+{
+	Arena* arena = new Arena(m_options.fit_policy, m_options.empty_pages_limit, m_options.huge_pages);
+	arena->init();
+	arena->threads_count.store(threads_count, std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> guard(m_arenas_lock);
+	if (m_purger.is_running()) {
+		defer_purging(*arena, true);
+	}
+	arena->index = m_arenas_count.load(std::memory_order_relaxed);
+	arena->next_arena = m_arenas.load(std::memory_order_relaxed);
+	m_arenas.store(arena, std::memory_order_release);
+	m_arenas_count.store(arena->index + 1, std::memory_order_release);
+	return arena;
+}
+
+Arena* MemoryAllocator::claim_arena()
+{
+	// arenas of exited threads are adopted with all their pages, pending remote frees included
+	for (Arena* arena_it = m_arenas.load(std::memory_order_acquire); arena_it; arena_it = arena_it->next_arena) {
+		int threads_count = 0;
+		if (arena_it->threads_count.load(std::memory_order_relaxed) == 0
+			&& arena_it->threads_count.compare_exchange_strong(threads_count, 1, std::memory_order_acquire)) {
+			return arena_it;
+		}
+	}
+	return create_arena(1);
+}
+
+void MemoryAllocator::attach_thread_cache(ThreadCache& cache)
+{
+	if (m_options.thread_arenas) {
+		cache.arena = claim_arena();
+		return;
+	}
+
+	int index = static_cast<int>(std::hash<std::thread::id>()(std::this_thread::get_id()) % get_arenas_count());
+	cache.arena = arena_at(index);
+	cache.arena->threads_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MemoryAllocator::detach_thread_cache(ThreadCache& cache)
+{
+	flush_thread_cache(cache);
+
+	// a thread arena left without its thread waits for adoption
+	cache.arena->threads_count.fetch_sub(1, std::memory_order_release);
+	cache.arena = nullptr;
+}
+
+void* MemoryAllocator::alloc_cached(int size_class)
+{
+	ThreadCache& cache = ThreadCache::of(*this);
+	void* ptr = cache.pop(size_class);
+	if (ptr) {
+		return ptr;
+	}
+
+	// magazine is empty, take a batch from the arena
+	const SizeClassDescriptor& descriptor = SizeClassDescriptors[size_class];
+	void* tier = cache.arena->fixed_size_tiers[size_class];
+	ThreadCache::Magazine& magazine = cache.magazines[size_class];
+	auto guard = lock_fixed_size(descriptor.get_lock(tier));
+	magazine.count = descriptor.alloc_batch(tier, magazine.blocks, ThreadCache::BatchSize);
+	return cache.pop(size_class);
+}
+
+void MemoryAllocator::free_cached(int size_class, void* p)
+{
+	ThreadCache& cache = ThreadCache::of(*this);
+	if (cache.push(size_class, p)) {
+		return;
+	}
+
+	// magazine is full, give the oldest half back and keep the recently used blocks,
+	// mostly these came from other threads, so they go to the remote lists without the lock
+	ThreadCache::Magazine& magazine = cache.magazines[size_class];
+	for (int i = 0; i < ThreadCache::BatchSize; ++i) {
+		free_remote(magazine.blocks[i]);
+	}
+	std::copy(magazine.blocks + ThreadCache::BatchSize, magazine.blocks + magazine.count, magazine.blocks);
+	magazine.count -= ThreadCache::BatchSize;
+
+	cache.push(size_class, p);
+}
+
+void MemoryAllocator::flush_thread_cache(ThreadCache& cache)
+{
+	for (int size_class = 0; size_class < SizeClassesCount; ++size_class) {
+		ThreadCache::Magazine& magazine = cache.magazines[size_class];
+		for (int i = 0; i < magazine.count; ++i) {
+			free_remote(magazine.blocks[i]);
+		}
+		magazine.count = 0;
+	}
+}
+
+void MemoryAllocator::free_remote(void* p)
+{
+	const SizeClassDescriptor& descriptor = SizeClassDescriptors[SlabRegion::instance().size_class_of(p)];
+	void* tier = fixed_size_page_of(p)->owner;
+	// the page may be empty once drained, nobody else would drain it before the next miss of an alloc;
+	// the tiers of a thread arena are drained by its owner only
+	if (descriptor.free_remote(tier, p) && !m_options.thread_arenas) {
+		auto guard = lock(descriptor.get_lock(tier));
+		descriptor.drain_remote_frees(tier);
+	}
+}
+
+std::unique_lock<std::mutex> MemoryAllocator::lock(std::mutex& tier_lock)
+{
+	if (m_options.concurrent) {
+		return std::unique_lock<std::mutex>(tier_lock);
+	}
+	return std::unique_lock<std::mutex>();
+}
+
+std::unique_lock<std::mutex> MemoryAllocator::lock_fixed_size(std::mutex& tier_lock)
+{
+	// fixed-size tiers of a thread arena are touched by the owner only, the others free remotely
+	if (m_options.thread_arenas) {
+		return std::unique_lock<std::mutex>();
+	}
+	return lock(tier_lock);
+}
+
+#ifdef _DEBUG
+
+void MemoryAllocator::dumpStat() const
+{
+	int coalesed_pages_count = 0;
+	int pages_count = 0;
+	for (Arena* arena_it = m_arenas.load(); arena_it; arena_it = arena_it->next_arena) {
+		coalesed_pages_count += arena_it->coalesed.get_pages_count();
+		pages_count += arena_it->get_fixed_size_pages_count();
+	}
+
+	std::cout << std::endl << "Total block statistics:" << std::endl;
+	std::cout << "Pages: " << std::endl;
+	std::cout << "size " << CoalesedPageSize << ": " << coalesed_pages_count << std::endl;
+	std::cout << "size " << PageSize << ": " << pages_count << std::endl;
+
+	for (Arena* arena_it = m_arenas.load(); arena_it; arena_it = arena_it->next_arena) {
+		arena_it->dumpStat();
+	}
+}
+
+void MemoryAllocator::dumpBlocks() const
+{
+	for (Arena* arena_it = m_arenas.load(); arena_it; arena_it = arena_it->next_arena) {
+		arena_it->dumpBlocks();
+	}
+}
+
 #endif
\ No newline at end of file
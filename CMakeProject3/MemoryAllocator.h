@@ -1,28 +1,132 @@
-#include "CoalesedAllocator.h"
-#include "FixedSizeAllocator.h"
-
-class MemoryAllocator
-{
-public:
-	MemoryAllocator() = default;
-	virtual ~MemoryAllocator() = default;
-
-	virtual void init();
-	virtual void destroy();
-	virtual void* alloc(size_t size);
-	virtual void free(void* p);
-
-#ifdef _DEBUG
-	virtual void dumpStat() const;
-	virtual void dumpBlocks() const;
-#endif
-
-private:
-	FixedSizeAllocator<16> m_fixed_size16;
-	FixedSizeAllocator<32> m_fixed_size32;
-	FixedSizeAllocator<64> m_fixed_size64;
-	FixedSizeAllocator<128> m_fixed_size128;
-	FixedSizeAllocator<256> m_fixed_size256;
-	FixedSizeAllocator<512> m_fixed_size512;
-	CoalesedAllocator m_coalesed;
+#pragma once
+
+#include "Arena.h"
+#include "HugeCache.h"
+#include "Purger.h"
+#include "ThreadCache.h"
+
+#include <atomic>
+#include <mutex>
+
+// final, so calls through the concrete type don't go through the vtable
+class MemoryAllocator final
+{
+public:
+	struct Options {
+		// every size class and the coalescing tier is guarded by its own lock,
+		// so threads allocating different sizes don't contend,
+		// fixed-size blocks are freed without the lock through the remote lists of their pages
+		bool concurrent = false;
+
+		// per-thread magazines in front of the fixed-size classes, implies concurrent
+		bool thread_cache = false;
+
+		// threads are spread over this many arenas by the hash of their id, more than one implies concurrent
+		int arenas = 1;
+
+		// every thread owns an arena and allocates fixed-size blocks from it without locks,
+		// arenas of exited threads are adopted by the next threads, implies concurrent and replaces arenas
+		bool thread_arenas = false;
+
+		// how the coalescing tier picks a free block
+		CoalesedAllocator::FitPolicy fit_policy = CoalesedAllocator::FitPolicy::SegregatedFit;
+
+		// empty pages every size class keeps, the others go back to the OS as soon as they get empty
+		int empty_pages_limit = DefaultEmptyPagesLimit;
+
+		// freed huge blocks are kept mapped for the next ones up to this many bytes and this long, zero bytes turns it off
+		size_t huge_cache_bytes = DefaultHugeCacheBytes;
+		std::chrono::milliseconds huge_cache_age = DefaultHugeCacheAge;
+
+		// coalescing pages and huge blocks ask for HugePageSize pages, huge blocks are mapped in whole huge pages
+		// at their alignment, fewer TLB misses over big buffers for up to a huge page of slack per block
+		bool huge_pages = false;
+	};
+
+	struct ArenaStats {
+		int threads_count; // threads allocating from the arena
+		int fixed_size_pages;
+		int coalesed_pages;
+		size_t released_fixed_size_pages; // given back to the OS since init
+		size_t purged_coalesed_bytes; // the same
+		size_t committed_coalesed_bytes;
+	};
+
+	MemoryAllocator() = default;
+	explicit MemoryAllocator(const Options& options)
+		: m_options(options)
+	{
+		m_options.concurrent |= m_options.thread_cache || m_options.thread_arenas || m_options.arenas > 1;
+	}
+	virtual ~MemoryAllocator() = default;
+
+	virtual void init();
+	virtual void destroy();
+	virtual void* alloc(size_t size);
+	// pointers which aren't a block given out are ignored: foreign ones, pointers into a block and blocks freed already
+	virtual void free(void* p);
+	// keeps the block where it is while its size class allows, coalesced blocks grow over a free neighbour
+	// and huge ones are remapped, nullptr p allocates, zero size frees
+	virtual void* realloc(void* p, size_t size);
+	// bytes the block can hold, at least the size it was allocated with, 0 for anything but a block given out,
+	// as free tells them: foreign pointers, pointers into a block and blocks freed already
+	size_t usable_size(const void* p) const;
+
+	// gives the blocks cached by the calling thread back to the shared tiers
+	void flush_thread_cache();
+
+	int get_arenas_count() const;
+	// index of the arena the calling thread allocates from
+	int get_arena();
+	// moves the calling thread to another arena, an owned thread arena can't be taken
+	bool select_arena(int index);
+	ArenaStats get_arena_stats(int index) const;
+
+	// starts the background purger, the tiers stop purging on free meanwhile,
+	// the allocator has to be concurrent as the purger is one more thread using it
+	bool start_purger(const Purger::Options& options = Purger::Options());
+	void stop_purger();
+	Purger::Stats get_purger_stats() const;
+
+	HugeCache::Stats get_huge_cache_stats();
+
+#ifdef _DEBUG
+	virtual void dumpStat() const;
+	virtual void dumpBlocks() const;
+#endif
+
+private:
+	friend class ThreadCache;
+	friend class Purger;
+
+	Arena& arena();
+	Arena* arena_at(int index) const;
+	Arena* create_arena(int threads_count);
+	Arena* claim_arena();
+	void attach_thread_cache(ThreadCache& cache);
+	void detach_thread_cache(ThreadCache& cache);
+
+	void* alloc_cached(int size_class);
+	void free_cached(int size_class, void* p);
+	void flush_thread_cache(ThreadCache& cache);
+	void free_remote(void* p);
+	void* map_huge(size_t mapping_size);
+	void* remap_huge(void* block, size_t size);
+	size_t huge_mapping_size(size_t size) const;
+	void defer_purging(Arena& arena, bool deferred);
+	size_t purge_decayed(int decay_ticks, double (*decay_curve)(double));
+	std::unique_lock<std::mutex> lock(std::mutex& tier_lock);
+	std::unique_lock<std::mutex> lock_fixed_size(std::mutex& tier_lock);
+
+	Options m_options;
+
+	std::atomic<Arena*> m_arenas{ nullptr }; // newest first, they live until destroy
+	std::atomic<int> m_arenas_count{ 0 };
+	std::mutex m_arenas_lock; // serializes creation of arenas
+
+	ThreadCache* m_thread_caches = nullptr; // guarded by the ThreadCache registry
+
+	HugeCache m_huge_cache;
+
+	Purger m_purger{ *this }; // stopped before the arenas go
 };
\ No newline at end of file
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "PageProvider.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// One global two-level radix map from every OS page the tiers own to the metadata of its tier page:
+// the FixedSizePage header, the coalescing page, or the start of a huge mapping. Any interior pointer
+// is looked up in two loads without touching the memory it points to, addresses nobody registered
+// give Kind::None. Tiers register their pages when they map or reuse them and clear them before
+// they unmap or retire them. The root and the leaves are mapped from the OS and backed lazily,
+// a leaf covers 1GB of address space on 64-bit targets.
+class PageMap
+{
+public:
+	enum class Kind : uintptr_t {
+		None,
+		FixedSize,
+		Coalesed,
+		Huge,
+	};
+
+	struct Entry {
+		Kind kind;
+		void* metadata;
+	};
+
+	static constexpr int GranuleShift = 12; // the smallest OS page
+	static constexpr int AddressBits = sizeof(void*) == 8 ? 48 : 32;
+	static constexpr int LeafBits = (AddressBits - GranuleShift) / 2;
+	static constexpr int RootBits = AddressBits - GranuleShift - LeafBits;
+	static constexpr size_t LeafSize = size_t(1) << LeafBits;
+	static constexpr size_t RootSize = size_t(1) << RootBits;
+
+	static PageMap& instance()
+	{
+		// never destroyed: allocators living in static storage may still unmap pages at exit
+		static PageMap* map = new PageMap();
+		return *map;
+	}
+
+	// metadata is aligned to 8 bytes at least, the kind is kept in its low bits; false if a leaf or the root can't be mapped
+	bool set(const void* begin, size_t size, Kind kind, void* metadata)
+	{
+		return store(begin, size, reinterpret_cast<uintptr_t>(metadata) | static_cast<uintptr_t>(kind));
+	}
+
+	void clear(const void* begin, size_t size)
+	{
+		store(begin, size, 0);
+	}
+
+	// clears only the entries which still hold this registration, for a range which may have been
+	// given up to the OS already and registered by somebody else meanwhile
+	void clear(const void* begin, size_t size, Kind kind, void* metadata)
+	{
+		store(begin, size, 0, reinterpret_cast<uintptr_t>(metadata) | static_cast<uintptr_t>(kind));
+	}
+
+	Entry lookup(const void* p) const
+	{
+		uintptr_t index = reinterpret_cast<uintptr_t>(p) >> GranuleShift;
+		if (!root || index >> (RootBits + LeafBits)) {
+			return Entry{ Kind::None, nullptr };
+		}
+		Leaf* leaf = root[index >> LeafBits].load(std::memory_order_acquire);
+		uintptr_t value = leaf ? leaf->entries[index & (LeafSize - 1)].load(std::memory_order_acquire) : 0;
+		return Entry{ static_cast<Kind>(value & KindMask), reinterpret_cast<void*>(value & ~KindMask) };
+	}
+
+	// leaves mapped since start, every one reserves LeafSize entries
+	size_t get_leaves_count() const
+	{
+		return leaves_count.load(std::memory_order_relaxed);
+	}
+
+private:
+	static constexpr uintptr_t KindMask = 7;
+	static constexpr uintptr_t AnyValue = ~uintptr_t(0); // no registration has all the kind bits set
+
+	// the mapped memory reads as zeroes, so every entry starts as Kind::None
+	struct Leaf {
+		std::atomic<uintptr_t> entries[LeafSize];
+	};
+
+	// without the root nothing can be registered: set fails as a leaf would, so the tiers fail their allocations
+	PageMap()
+		: root(reinterpret_cast<std::atomic<Leaf*>*>(PageProvider::map(RootSize * sizeof(std::atomic<Leaf*>))))
+	{}
+
+	// entries which don't hold expected are kept, unless any value is expected
+	bool store(const void* begin, size_t size, uintptr_t value, uintptr_t expected = AnyValue)
+	{
+		uintptr_t first = reinterpret_cast<uintptr_t>(begin) >> GranuleShift;
+		uintptr_t last = (reinterpret_cast<uintptr_t>(begin) + size - 1) >> GranuleShift;
+		// leaf by leaf, a huge mapping spans thousands of entries
+		for (uintptr_t index = first; index <= last; index = (index | (LeafSize - 1)) + 1) {
+			Leaf* leaf = leaf_of(index, value != 0);
+			if (!leaf) {
+				if (value) {
+					return false;
+				}
+				// nothing was registered under an absent leaf
+				continue;
+			}
+			uintptr_t leaf_last = std::min<uintptr_t>(last, index | (LeafSize - 1));
+			for (uintptr_t entry = index; entry <= leaf_last; ++entry) {
+				std::atomic<uintptr_t>& slot = leaf->entries[entry & (LeafSize - 1)];
+				if (expected == AnyValue) {
+					slot.store(value, std::memory_order_release);
+					continue;
+				}
+				uintptr_t old_value = expected;
+				slot.compare_exchange_strong(old_value, value, std::memory_order_acq_rel);
+			}
+		}
+		return true;
+	}
+
+	Leaf* leaf_of(uintptr_t index, bool create)
+	{
+		if (!root) {
+			return nullptr;
+		}
+		std::atomic<Leaf*>& slot = root[index >> LeafBits];
+		Leaf* leaf = slot.load(std::memory_order_acquire);
+		if (leaf || !create) {
+			return leaf;
+		}
+
+		Leaf* new_leaf = reinterpret_cast<Leaf*>(PageProvider::map(sizeof(Leaf)));
+		if (!new_leaf) {
+			return nullptr;
+		}
+		// another thread may have mapped the leaf meanwhile
+		if (!slot.compare_exchange_strong(leaf, new_leaf, std::memory_order_acq_rel)) {
+			PageProvider::unmap(new_leaf, sizeof(Leaf));
+			return leaf;
+		}
+		leaves_count.fetch_add(1, std::memory_order_relaxed);
+		return new_leaf;
+	}
+
+	std::atomic<Leaf*>* root; // nullptr if it couldn't be mapped
+	std::atomic<size_t> leaves_count{ 0 };
+};
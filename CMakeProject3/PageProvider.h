@@ -0,0 +1,256 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _WIN32
+// the min and max macros of windows.h would break std::min and std::max in every file including this one
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Page providers hand out read-write, non-executable memory straight from the OS.
+// Every tier goes through PageProvider, so porting to a new platform means adding
+// one more provider with the same static interface:
+//   static void* map(size_t size);                            // nullptr on failure
+//   static void* map_aligned(size_t size, size_t alignment);  // alignment is a power of two
+//   static void unmap(void* p, size_t size);                  // size is the one passed to map
+//   static void purge(void* p, size_t size);                  // drops the contents, the range stays read-write
+//   static bool shrink(void* p, size_t size, size_t new_size); // gives the end of a mapping back in place, false if it can't
+//   static bool remap(void* p, size_t size, void* target, size_t new_size); // moves a mapping with its contents onto
+//                                                             // a range reserved at target, resized to new_size;
+//                                                             // false if it can't, p stays mapped then, target is given up either way
+//   static void advise_huge_pages(void* p, size_t size);      // a hint to back the range with HugePageSize pages
+// and for address space which is reserved up front and backed on demand:
+//   static void* reserve(size_t size);                        // inaccessible until committed
+//   static void* reserve_aligned(size_t size, size_t alignment);
+//   static bool commit(void* p, size_t size);                 // makes the range read-write
+//   static void decommit(void* p, size_t size);               // gives the memory back, keeps the range
+// A reserved range is released with unmap.
+
+// large pages of x86-64 and arm64 with 4K base pages, one TLB entry covers all of it
+constexpr size_t HugePageSize = 1024*1024*2;
+
+#ifdef _WIN32
+class Win32PageProvider
+{
+public:
+	static void* map(size_t size)
+	{
+		return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	}
+
+	static void* map_aligned(size_t size, size_t alignment)
+	{
+		if (alignment <= granularity()) {
+			return map(size);
+		}
+		return alloc_aligned(size, alignment, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	}
+
+	static void unmap(void* p, size_t /*size*/)
+	{
+		VirtualFree(p, 0, MEM_RELEASE);
+	}
+
+	static void purge(void* p, size_t size)
+	{
+		VirtualAlloc(p, size, MEM_RESET, PAGE_READWRITE);
+	}
+
+	static bool shrink(void* /*p*/, size_t /*size*/, size_t /*new_size*/)
+	{
+		// a reservation is only ever released whole
+		return false;
+	}
+
+	static bool remap(void* /*p*/, size_t /*size*/, void* target, size_t new_size)
+	{
+		// a placeholder could be split or extended in place, but there is no way to move the pages
+		unmap(target, new_size);
+		return false;
+	}
+
+	static void advise_huge_pages(void* /*p*/, size_t /*size*/)
+	{
+		// large pages need the lock memory privilege and are committed up front, so they aren't used
+	}
+
+	static void* reserve(size_t size)
+	{
+		return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+	}
+
+	static void* reserve_aligned(size_t size, size_t alignment)
+	{
+		if (alignment <= granularity()) {
+			return reserve(size);
+		}
+		return alloc_aligned(size, alignment, MEM_RESERVE, PAGE_NOACCESS);
+	}
+
+	static bool commit(void* p, size_t size)
+	{
+		return VirtualAlloc(p, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+	}
+
+	static void decommit(void* p, size_t size)
+	{
+		VirtualFree(p, size, MEM_DECOMMIT);
+	}
+
+	static size_t granularity()
+	{
+		static const size_t allocation_granularity = [] {
+			SYSTEM_INFO info;
+			GetSystemInfo(&info);
+			return static_cast<size_t>(info.dwAllocationGranularity);
+		}();
+		return allocation_granularity;
+	}
+
+private:
+	static void* alloc_aligned(size_t size, size_t alignment, DWORD allocation_type, DWORD protection)
+	{
+		while (true) {
+			// find a suitable hole, then take its aligned part
+			void* probe = VirtualAlloc(NULL, size + alignment, MEM_RESERVE, PAGE_NOACCESS);
+			if (!probe) {
+				return nullptr;
+			}
+			uintptr_t aligned = (reinterpret_cast<uintptr_t>(probe) + alignment - 1) & ~(alignment - 1);
+			VirtualFree(probe, 0, MEM_RELEASE);
+
+			void* p = VirtualAlloc(reinterpret_cast<void*>(aligned), size, allocation_type, protection);
+			if (p) {
+				return p;
+			}
+			// somebody has taken the hole in between, try again
+		}
+	}
+};
+
+using PageProvider = Win32PageProvider;
+#else
+class MmapPageProvider
+{
+public:
+	static void* map(size_t size)
+	{
+		void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return p == MAP_FAILED ? nullptr : p;
+	}
+
+	static void* map_aligned(size_t size, size_t alignment)
+	{
+		if (alignment <= granularity()) {
+			return map(size);
+		}
+		return trim_to_alignment(map(size + alignment), size, alignment);
+	}
+
+	static void unmap(void* p, size_t size)
+	{
+		munmap(p, size);
+	}
+
+	static void purge(void* p, size_t size)
+	{
+		// the pages read as zeroes on the next touch
+		madvise(p, size, MADV_DONTNEED);
+	}
+
+	static bool shrink(void* p, size_t size, size_t new_size)
+	{
+		// the whole pages past the new end go, the rest of the mapping stays where it is
+		uintptr_t end = (reinterpret_cast<uintptr_t>(p) + new_size + granularity() - 1) & ~(granularity() - 1);
+		uintptr_t old_end = reinterpret_cast<uintptr_t>(p) + size;
+		return end >= old_end || munmap(reinterpret_cast<void*>(end), old_end - end) == 0;
+	}
+
+	static bool remap(void* p, size_t size, void* target, size_t new_size)
+	{
+#if defined(MREMAP_MAYMOVE) && defined(MREMAP_FIXED)
+		// the page tables are moved, not the bytes. The kernel unmaps the reservation before it moves anything,
+		// it's kept only when the process is out of mappings altogether, and nobody can tell it's still there then
+		return mremap(p, size, new_size, MREMAP_MAYMOVE | MREMAP_FIXED, target) != MAP_FAILED;
+#else
+		(void)p;
+		(void)size;
+		unmap(target, new_size);
+		return false;
+#endif
+	}
+
+	static void advise_huge_pages(void* p, size_t size)
+	{
+#ifdef MADV_HUGEPAGE
+		// transparent huge pages back the aligned parts on the first touch, or later by khugepaged
+		madvise(p, size, MADV_HUGEPAGE);
+#else
+		(void)p;
+		(void)size;
+#endif
+	}
+
+	static void* reserve(size_t size)
+	{
+		void* p = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		return p == MAP_FAILED ? nullptr : p;
+	}
+
+	static void* reserve_aligned(size_t size, size_t alignment)
+	{
+		if (alignment <= granularity()) {
+			return reserve(size);
+		}
+		return trim_to_alignment(reserve(size + alignment), size, alignment);
+	}
+
+	static bool commit(void* p, size_t size)
+	{
+		return mprotect(p, size, PROT_READ | PROT_WRITE) == 0;
+	}
+
+	static void decommit(void* p, size_t size)
+	{
+		// mapping fresh inaccessible pages over the range drops both the memory and its commit charge
+		mmap(p, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+	}
+
+	static size_t granularity()
+	{
+		static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		return page_size;
+	}
+
+private:
+	// p is mapped with a slack of alignment bytes, the unaligned head and the rest of the tail are cut off
+	static void* trim_to_alignment(void* p, size_t size, size_t alignment)
+	{
+		if (!p) {
+			return nullptr;
+		}
+		size_t padded_size = size + alignment;
+		uintptr_t begin = reinterpret_cast<uintptr_t>(p);
+		uintptr_t aligned = (begin + alignment - 1) & ~(alignment - 1);
+		if (aligned != begin) {
+			munmap(p, aligned - begin);
+		}
+		if (begin + padded_size != aligned + size) {
+			munmap(reinterpret_cast<void*>(aligned + size), begin + padded_size - aligned - size);
+		}
+		return reinterpret_cast<void*>(aligned);
+	}
+};
+
+using PageProvider = MmapPageProvider;
+#endif
@@ -0,0 +1,53 @@
+#include "Purger.h"
+#include "MemoryAllocator.h"
+
+#include <algorithm>
+
+void Purger::start(const Options& options)
+{
+	stop();
+
+	this->options = options;
+	stop_requested = false;
+	thread = std::thread([this]() {
+		run();
+	});
+}
+
+void Purger::stop()
+{
+	if (!thread.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stop_requested = true;
+	}
+	wakeup.notify_all();
+	thread.join();
+}
+
+Purger::Stats Purger::get_stats() const
+{
+	Stats stats;
+	stats.intervals = intervals.load(std::memory_order_relaxed);
+	stats.last_interval_bytes = last_interval_bytes.load(std::memory_order_relaxed);
+	stats.total_bytes = total_bytes.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void Purger::run()
+{
+	int decay_ticks = static_cast<int>(std::max<long long>(options.decay_time.count() / std::max<long long>(options.interval.count(), 1), 1));
+
+	std::unique_lock<std::mutex> guard(lock);
+	while (!wakeup.wait_for(guard, options.interval, [this]() { return stop_requested; })) {
+		guard.unlock();
+		size_t purged_bytes = owner.purge_decayed(decay_ticks, options.decay_curve);
+		guard.lock();
+
+		last_interval_bytes.store(purged_bytes, std::memory_order_relaxed);
+		total_bytes.fetch_add(purged_bytes, std::memory_order_relaxed);
+		intervals.fetch_add(1, std::memory_order_release);
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+class MemoryAllocator;
+
+// Decay curves: the share of the unused memory which is kept after age decay times,
+// 1 for the memory which just got unused, 0 for the memory unused for the whole decay time.
+inline double linear_decay(double age)
+{
+	return age < 1 ? 1 - age : 0;
+}
+
+// keeps most of the recently freed memory for reuse and lets the old one go quickly
+inline double smoothstep_decay(double age)
+{
+	return age < 1 ? 1 - age * age * (3 - 2 * age) : 0;
+}
+
+// Background thread which gives the memory unused for the decay time back to the OS,
+// so the madvise/munmap calls are off the alloc and free paths and RSS still follows the load.
+// Every interval the empty fixed-size pages and the free coalesced blocks get a tick older,
+// the oldest ones are purged until the rest fits the decay curve.
+class Purger
+{
+public:
+	struct Options {
+		std::chrono::milliseconds interval{ 100 };
+		std::chrono::milliseconds decay_time{ 10000 };
+		double (*decay_curve)(double) = smoothstep_decay;
+	};
+
+	struct Stats {
+		int intervals;
+		size_t last_interval_bytes; // purged in the last interval
+		size_t total_bytes;
+	};
+
+	explicit Purger(MemoryAllocator& owner)
+		: owner(owner)
+	{}
+	~Purger()
+	{
+		stop();
+	}
+
+	Purger(const Purger&) = delete;
+	Purger& operator=(const Purger&) = delete;
+
+	void start(const Options& options);
+	void stop();
+	bool is_running() const
+	{
+		return thread.joinable();
+	}
+	Stats get_stats() const;
+
+private:
+	void run();
+
+	MemoryAllocator& owner;
+	Options options;
+	std::thread thread;
+
+	std::mutex lock;
+	std::condition_variable wakeup;
+	bool stop_requested = false;
+
+	std::atomic<int> intervals{ 0 };
+	std::atomic<size_t> last_interval_bytes{ 0 };
+	std::atomic<size_t> total_bytes{ 0 };
+};
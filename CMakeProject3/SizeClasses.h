@@ -0,0 +1,145 @@
+#pragma once
+
+#include "Bits.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+// Sizes of the fixed-size classes: 8, then 16 bytes apart up to 128, then four classes per doubling,
+// so a request wastes less than 16 bytes or a fifth of its slot. Classes above 8 are multiples of
+// SizeClassAlignment, so their blocks are aligned as malloc ones.
+constexpr size_t MaxFixedSize = 4096;
+constexpr size_t SizeClassAlignment = 16;
+
+static_assert(SizeClassAlignment >= alignof(std::max_align_t), "blocks of the classes hold any fundamental type");
+
+constexpr size_t next_size_class(size_t size)
+{
+	if (size < SizeClassAlignment) {
+		return SizeClassAlignment;
+	}
+	size_t group = 8;
+	while (group * 2 <= size) {
+		group *= 2;
+	}
+	return size + (group / 4 > SizeClassAlignment ? group / 4 : SizeClassAlignment);
+}
+
+constexpr int count_size_classes()
+{
+	int count = 0;
+	for (size_t size = 8; size <= MaxFixedSize; size = next_size_class(size)) {
+		++count;
+	}
+	return count;
+}
+
+constexpr int SizeClassesCount = count_size_classes();
+
+constexpr std::array<size_t, SizeClassesCount> make_size_classes()
+{
+	std::array<size_t, SizeClassesCount> classes{};
+	size_t size = 8;
+	for (int i = 0; i < SizeClassesCount; ++i) {
+		classes[i] = size;
+		size = next_size_class(size);
+	}
+	return classes;
+}
+
+constexpr std::array<size_t, SizeClassesCount> SizeClasses = make_size_classes();
+
+static_assert(SizeClasses[SizeClassesCount - 1] == MaxFixedSize, "the last class takes the largest fixed-size blocks");
+
+constexpr bool size_classes_aligned()
+{
+	for (int i = 1; i < SizeClassesCount; ++i) {
+		if (SizeClasses[i] % SizeClassAlignment) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static_assert(size_classes_aligned(), "the blocks of every class but the first are aligned as malloc ones");
+
+// binary search over the table, only used to build the lookup tables
+constexpr int find_size_class(size_t size)
+{
+	int low = 0;
+	int high = SizeClassesCount - 1;
+	while (low < high) {
+		int middle = (low + high) / 2;
+		if (SizeClasses[middle] < size) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+// Sizes up to SmallLookupSize are looked up by (size + 7) >> 3,
+// above that every power of two holds four evenly spaced classes, so the class is found from log2 of the size.
+constexpr size_t SmallLookupSize = 1024;
+
+constexpr std::array<uint8_t, SmallLookupSize / 8 + 1> make_small_size_classes()
+{
+	std::array<uint8_t, SmallLookupSize / 8 + 1> classes{};
+	for (size_t i = 0; i < classes.size(); ++i) {
+		classes[i] = static_cast<uint8_t>(find_size_class(i * 8));
+	}
+	return classes;
+}
+
+constexpr std::array<uint8_t, SmallLookupSize / 8 + 1> SmallSizeClasses = make_small_size_classes();
+
+constexpr int LargeGroupsCount = 64;
+
+// first class above 2^k
+constexpr std::array<uint8_t, LargeGroupsCount> make_large_size_classes()
+{
+	std::array<uint8_t, LargeGroupsCount> classes{};
+	for (int k = 0; k < LargeGroupsCount; ++k) {
+		size_t group = size_t(1) << k;
+		classes[k] = static_cast<uint8_t>(group >= SmallLookupSize && group < MaxFixedSize ? find_size_class(group + 1) : 0);
+	}
+	return classes;
+}
+
+constexpr std::array<uint8_t, LargeGroupsCount> LargeSizeClasses = make_large_size_classes();
+
+// smallest class which fits the size, size must be at most MaxFixedSize
+inline int size_class_of(size_t size)
+{
+	if (size <= SmallLookupSize) {
+		return SmallSizeClasses[(size + 7) >> 3];
+	}
+	int k = floor_log2(size - 1);
+	return LargeSizeClasses[k] + static_cast<int>((size - 1 - (size_t(1) << k)) >> (k - 2));
+}
+
+namespace detail {
+
+template<class F, size_t... I>
+decltype(auto) with_size_class(int size_class, F& f, std::index_sequence<I...>)
+{
+	using Result = decltype(f(std::integral_constant<int, 0>()));
+	static constexpr Result (*table[])(F&) = {
+		[](F& f) -> Result { return f(std::integral_constant<int, I>()); }...
+	};
+	return table[size_class](f);
+}
+
+}
+
+// calls f with std::integral_constant of the class, so the class can be used as a template argument
+template<class F>
+decltype(auto) with_size_class(int size_class, F&& f)
+{
+	return detail::with_size_class(size_class, f, std::make_index_sequence<SizeClassesCount>());
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include "Bits.h"
+#include "PageMap.h"
+#include "PageProvider.h"
+#include "SizeClasses.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// big enough to keep the largest size classes dense, a power of two for masking
+constexpr size_t PageSize = 32 * 1024;
+
+// pages are committed and decommitted this much at a time, one syscall for 64 pages
+constexpr size_t SlabChunkSize = 2 * 1024 * 1024;
+constexpr int PagesInChunk = static_cast<int>(SlabChunkSize / PageSize);
+
+static_assert(SlabChunkSize % PageSize == 0, "a chunk is made of whole pages");
+static_assert(PagesInChunk <= 64, "the free pages of a chunk are a 64-bit mask");
+
+// All fixed-size pages are carved from one reserved range of address space,
+// every size class owns an equal slice of it. Fixed-size blocks have no header:
+// a pointer is recognised as a fixed-size one by a range check, its size class
+// is the index of its slice and its page header is found by masking the pointer.
+// Slices are committed and decommitted in whole chunks: released pages are purged and
+// wait in their chunk, a chunk whose pages are all free is decommitted with one call
+// and committed again when it's needed.
+class SlabRegion
+{
+public:
+	static constexpr size_t MaxRegionSize = sizeof(void*) == 8 ? (size_t(128) << 30) : (size_t(256) << 20);
+	static constexpr size_t MinRegionSize = size_t(16) << 20;
+	// a power of two, so the slices are too
+	static constexpr size_t SlicesCount = round_up_to_power_of_two(SizeClassesCount);
+
+	static SlabRegion& instance()
+	{
+		// never destroyed: allocators living in static storage may still release pages at exit
+		static SlabRegion* region = new SlabRegion();
+		return *region;
+	}
+
+	bool contains(const void* p) const
+	{
+		return reinterpret_cast<uintptr_t>(p) - begin < size;
+	}
+
+	// size class of a pointer the region contains, found without reading any memory
+	int size_class_of(const void* p) const
+	{
+		return static_cast<int>((reinterpret_cast<uintptr_t>(p) - begin) >> slice_shift);
+	}
+
+	// the page is registered in PageMap with itself as the metadata, FixedSizePage lives at its start
+	void* acquire_page(int size_class)
+	{
+		void* page = take_page(slices[size_class]);
+		if (page && !PageMap::instance().set(page, PageSize, PageMap::Kind::FixedSize, page)) {
+			release_page(page);
+			return nullptr;
+		}
+		return page;
+	}
+
+	void release_page(void* page)
+	{
+		assert(contains(page));
+		PageMap::instance().clear(page, PageSize);
+
+		Slice& slice = slices[size_class_of(page)];
+		size_t offset = reinterpret_cast<std::byte*>(page) - slice.begin;
+		uint32_t index = static_cast<uint32_t>(offset / SlabChunkSize);
+		std::lock_guard<std::mutex> guard(slice.lock);
+		Chunk& chunk = slice.chunks[index];
+		if (!chunk.free_pages) {
+			chunk.partial_index = static_cast<int>(slice.partial_chunks.size());
+			slice.partial_chunks.push_back(index);
+		}
+		chunk.free_pages |= uint64_t(1) << (offset % SlabChunkSize / PageSize);
+		if (chunk.free_pages == full_mask(slice, index)) {
+			// the whole chunk goes back at once, the page with it
+			decommit_chunk(slice, index);
+			return;
+		}
+		// the memory goes back before the page can be taken again
+		PageProvider::purge(page, PageSize);
+	}
+
+	// commits of chunks since start, every one was a single syscall
+	size_t get_chunks_count() const
+	{
+		return chunks_count.load(std::memory_order_relaxed);
+	}
+
+	// chunks decommitted since start as all their pages got free
+	size_t get_released_chunks_count() const
+	{
+		return released_chunks_count.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Chunk
+	{
+		uint64_t free_pages = 0; // a bit per page, set while the page is committed and not handed out
+		int partial_index = -1; // in partial_chunks while some pages are free
+	};
+
+	// aligned to a cache line, so the locks of neighbouring size classes don't share one
+	struct alignas(64) Slice
+	{
+		std::mutex lock;
+		std::byte* begin = nullptr;
+		std::byte* top = nullptr; // chunks below were committed at least once
+		std::byte* end = nullptr;
+		std::vector<Chunk> chunks; // up to top
+		std::vector<uint32_t> partial_chunks; // committed ones with free pages
+		std::vector<uint32_t> decommitted_chunks; // below top, reused before fresh ones
+	};
+
+	void* take_page(Slice& slice)
+	{
+		std::lock_guard<std::mutex> guard(slice.lock);
+
+		if (slice.partial_chunks.empty() && !commit_chunk(slice)) {
+			return nullptr;
+		}
+		// the last chunk with free pages is filled up first, the others may get empty meanwhile
+		uint32_t index = slice.partial_chunks.back();
+		Chunk& chunk = slice.chunks[index];
+		int page = lowest_bit(chunk.free_pages);
+		chunk.free_pages &= chunk.free_pages - 1;
+		if (!chunk.free_pages) {
+			slice.partial_chunks.pop_back();
+			chunk.partial_index = -1;
+		}
+		return slice.begin + index * SlabChunkSize + page * PageSize;
+	}
+
+	SlabRegion()
+	{
+		// take as much as the system agrees to give
+		for (size_t region_size = MaxRegionSize; region_size >= MinRegionSize; region_size /= 2) {
+			// pages are masked by their size
+			void* p = PageProvider::reserve_aligned(region_size, PageSize);
+			if (p) {
+				begin = reinterpret_cast<uintptr_t>(p);
+				size = region_size;
+				slice_shift = floor_log2(region_size / SlicesCount);
+				for (size_t i = 0; i < SlicesCount; ++i) {
+					slices[i].begin = reinterpret_cast<std::byte*>(begin + (i << slice_shift));
+					slices[i].top = slices[i].begin;
+					slices[i].end = slices[i].begin + (size_t(1) << slice_shift);
+				}
+				break;
+			}
+		}
+	}
+
+	// slices smaller than a chunk on small regions have a single short chunk
+	static size_t chunk_size(const Slice& slice, uint32_t index)
+	{
+		return std::min<size_t>(SlabChunkSize, slice.end - slice.begin - index * SlabChunkSize);
+	}
+
+	static uint64_t full_mask(const Slice& slice, uint32_t index)
+	{
+		size_t pages_count = chunk_size(slice, index) / PageSize;
+		return pages_count == 64 ? ~uint64_t(0) : (uint64_t(1) << pages_count) - 1;
+	}
+
+	// a decommitted chunk or a fresh one becomes a partial chunk with all pages free, the lock of the slice is held
+	bool commit_chunk(Slice& slice)
+	{
+		uint32_t index;
+		if (!slice.decommitted_chunks.empty()) {
+			index = slice.decommitted_chunks.back();
+		}
+		else {
+			if (slice.top == slice.end) {
+				return false;
+			}
+			index = static_cast<uint32_t>(slice.chunks.size());
+		}
+		if (!PageProvider::commit(slice.begin + index * SlabChunkSize, chunk_size(slice, index))) {
+			return false;
+		}
+
+		if (!slice.decommitted_chunks.empty()) {
+			slice.decommitted_chunks.pop_back();
+		}
+		else {
+			slice.chunks.emplace_back();
+			slice.top += chunk_size(slice, index);
+		}
+		Chunk& chunk = slice.chunks[index];
+		chunk.free_pages = full_mask(slice, index);
+		chunk.partial_index = static_cast<int>(slice.partial_chunks.size());
+		slice.partial_chunks.push_back(index);
+		chunks_count.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// all pages of the chunk are free, the lock of the slice is held
+	void decommit_chunk(Slice& slice, uint32_t index)
+	{
+		Chunk& chunk = slice.chunks[index];
+		uint32_t last = slice.partial_chunks.back();
+		slice.partial_chunks[chunk.partial_index] = last;
+		slice.chunks[last].partial_index = chunk.partial_index;
+		slice.partial_chunks.pop_back();
+		chunk.partial_index = -1;
+		chunk.free_pages = 0;
+
+		PageProvider::decommit(slice.begin + index * SlabChunkSize, chunk_size(slice, index));
+		slice.decommitted_chunks.push_back(index);
+		released_chunks_count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	uintptr_t begin = 0;
+	size_t size = 0;
+	int slice_shift = 0;
+
+	Slice slices[SlicesCount];
+	std::atomic<size_t> chunks_count{ 0 };
+	std::atomic<size_t> released_chunks_count{ 0 };
+};
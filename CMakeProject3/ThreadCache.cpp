@@ -0,0 +1,95 @@
+#include "ThreadCache.h"
+#include "MemoryAllocator.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// guards ThreadCache::owner changes and the cache lists of the allocators
+std::mutex& registry_lock()
+{
+	static std::mutex* lock = new std::mutex();
+	return *lock;
+}
+
+}
+
+// caches of one thread, they are given back to their owners when the thread exits
+struct ThreadCacheList
+{
+	~ThreadCacheList()
+	{
+		std::lock_guard<std::mutex> guard(registry_lock());
+		for (auto& cache : caches) {
+			if (cache->owner.load(std::memory_order_relaxed)) {
+				ThreadCache::detach(*cache);
+			}
+		}
+	}
+
+	std::vector<std::unique_ptr<ThreadCache>> caches;
+	ThreadCache* last = nullptr;
+};
+
+ThreadCache& ThreadCache::of(MemoryAllocator& owner)
+{
+	thread_local ThreadCacheList list;
+
+	if (list.last && list.last->owner.load(std::memory_order_relaxed) == &owner) {
+		return *list.last;
+	}
+
+	ThreadCache* unused_cache = nullptr;
+	for (auto& cache : list.caches) {
+		MemoryAllocator* cache_owner = cache->owner.load(std::memory_order_relaxed);
+		if (cache_owner == &owner) {
+			list.last = cache.get();
+			return *cache;
+		}
+		if (!cache_owner) {
+			unused_cache = cache.get();
+		}
+	}
+
+	// first call from this thread, caches of destroyed allocators are empty and can be reused
+	if (!unused_cache) {
+		list.caches.push_back(std::make_unique<ThreadCache>());
+		unused_cache = list.caches.back().get();
+	}
+
+	owner.attach_thread_cache(*unused_cache);
+	{
+		std::lock_guard<std::mutex> guard(registry_lock());
+		unused_cache->owner.store(&owner, std::memory_order_relaxed);
+		unused_cache->next_of_owner = owner.m_thread_caches;
+		owner.m_thread_caches = unused_cache;
+	}
+
+	list.last = unused_cache;
+	return *unused_cache;
+}
+
+void ThreadCache::detach_all(MemoryAllocator& owner)
+{
+	std::lock_guard<std::mutex> guard(registry_lock());
+	while (owner.m_thread_caches) {
+		detach(*owner.m_thread_caches);
+	}
+}
+
+void ThreadCache::detach(ThreadCache& cache)
+{
+	MemoryAllocator* owner = cache.owner.load(std::memory_order_relaxed);
+	owner->detach_thread_cache(cache);
+
+	ThreadCache** it = &owner->m_thread_caches;
+	while (*it != &cache) {
+		it = &(*it)->next_of_owner;
+	}
+	*it = cache.next_of_owner;
+
+	cache.next_of_owner = nullptr;
+	cache.owner.store(nullptr, std::memory_order_relaxed);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "SizeClasses.h"
+
+#include <atomic>
+#include <cstddef>
+
+class Arena;
+class MemoryAllocator;
+
+// Per-thread state of an allocator: the arena the thread allocates from
+// and magazines of free fixed-size blocks, one bounded LIFO stack per size class.
+// Most alloc/free pairs of a thread are served here without touching shared state,
+// MemoryAllocator refills and flushes the magazines in batches of BatchSize blocks.
+class ThreadCache
+{
+public:
+	static constexpr int Capacity = 64;
+	static constexpr int BatchSize = Capacity / 2;
+
+	struct Magazine {
+		int count = 0;
+		void* blocks[Capacity];
+	};
+
+	// cache of the calling thread for the allocator, created on first use
+	static ThreadCache& of(MemoryAllocator& owner);
+
+	// flushes the caches of all threads into the allocator and forgets them,
+	// no other thread may use the allocator meanwhile
+	static void detach_all(MemoryAllocator& owner);
+
+	void* pop(int size_class)
+	{
+		Magazine& magazine = magazines[size_class];
+		if (magazine.count == 0) {
+			return nullptr;
+		}
+		return magazine.blocks[--magazine.count];
+	}
+
+	bool push(int size_class, void* p)
+	{
+		Magazine& magazine = magazines[size_class];
+		if (magazine.count == Capacity) {
+			return false;
+		}
+		magazine.blocks[magazine.count++] = p;
+		return true;
+	}
+
+	Magazine magazines[SizeClassesCount];
+	Arena* arena = nullptr; // set by MemoryAllocator when the cache is created
+
+private:
+	friend struct ThreadCacheList;
+
+	// gives the cache back to the owner and unlinks it, registry lock must be held
+	static void detach(ThreadCache& cache);
+
+	std::atomic<MemoryAllocator*> owner{ nullptr }; // nullptr once the owner is destroyed
+	ThreadCache* next_of_owner = nullptr; // all caches of the owner, see MemoryAllocator::m_thread_caches
+};